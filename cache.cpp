@@ -0,0 +1,147 @@
+#include "cache.hpp"
+
+#include <cstdio>
+
+uint64_t hashBytes(const void* data, size_t numBytes, uint64_t hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < numBytes; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+uint64_t hashMeshGeometry(const Mesh& mesh) {
+  uint64_t hash = hashBytes(&mesh.numVertices, sizeof(mesh.numVertices));
+  hash = hashBytes(&mesh.numIndices, sizeof(mesh.numIndices), hash);
+  hash = hashBytes(mesh.positions, sizeof(HMM_Vec3) * mesh.numVertices, hash);
+  hash = hashBytes(mesh.normals, sizeof(HMM_Vec3) * mesh.numVertices, hash);
+  return hashBytes(mesh.indices, sizeof(unsigned int) * mesh.numIndices, hash);
+}
+
+uint64_t hashSceneGeometry(const Scene& scene) {
+  uint64_t* meshHashes = new uint64_t[scene.numMeshes];
+  for (uint32_t meshIx = 0; meshIx < scene.numMeshes; ++meshIx) {
+    meshHashes[meshIx] = hashMeshGeometry(scene.meshes[meshIx]);
+  }
+  uint64_t hash = hashBytes(&scene.numInstances, sizeof(scene.numInstances));
+  for (uint32_t instIx = 0; instIx < scene.numInstances; ++instIx) {
+    const Instance& inst = scene.instances[instIx];
+    hash = hashBytes(&meshHashes[inst.meshIx], sizeof(uint64_t), hash);
+    hash = hashBytes(&inst.worldFromObject, sizeof(HMM_Mat4), hash);
+  }
+  delete[] meshHashes;
+  return hash;
+}
+
+uint64_t hashSingleMeshSceneGeometry(uint64_t meshHash) {
+  const uint32_t numInstances = 1;
+  const Instance inst;
+  uint64_t hash = hashBytes(&numInstances, sizeof(numInstances));
+  hash = hashBytes(&meshHash, sizeof(uint64_t), hash);
+  return hashBytes(&inst.worldFromObject, sizeof(HMM_Mat4), hash);
+}
+
+uint64_t hashBakeSettings(const GatherSettings& settings,
+                          const HMM_Vec3* emission, uint32_t numVertices) {
+  uint64_t hash =
+      hashBytes(&settings.viewportSide, sizeof(settings.viewportSide));
+  hash = hashBytes(&settings.highFOV, sizeof(settings.highFOV), hash);
+  hash = hashBytes(&settings.nearPlane, sizeof(settings.nearPlane), hash);
+  hash = hashBytes(&settings.farPlane, sizeof(settings.farPlane), hash);
+  hash = hashBytes(&settings.numBounces, sizeof(settings.numBounces), hash);
+  hash = hashBytes(&settings.colorFormat, sizeof(settings.colorFormat), hash);
+  hash = hashBytes(&settings.depthFormat, sizeof(settings.depthFormat), hash);
+  hash = hashBytes(&settings.radianceFormat, sizeof(settings.radianceFormat),
+                   hash);
+  // numViewports only batches the work, it does not change the result
+  return hashBytes(emission, sizeof(HMM_Vec3) * numVertices, hash);
+}
+
+BakeCacheMatch openBakeCache(const char* fileName, uint64_t meshHash,
+                             uint64_t settingsHash, uint32_t numVertices,
+                             BakeCache& cache) {
+  cache.file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (cache.file == INVALID_HANDLE_VALUE) {
+    return BakeCacheMatch::Missing;
+  }
+
+  LARGE_INTEGER fileSize{};
+  const uint64_t expectedSize =
+      sizeof(BakeCacheHeader) + sizeof(HMM_Vec3) * uint64_t{numVertices};
+  if (!GetFileSizeEx(cache.file, &fileSize) ||
+      static_cast<uint64_t>(fileSize.QuadPart) != expectedSize) {
+    closeBakeCache(cache);
+    return BakeCacheMatch::Missing;
+  }
+
+  cache.mapping =
+      CreateFileMappingA(cache.file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!cache.mapping) {
+    closeBakeCache(cache);
+    return BakeCacheMatch::Missing;
+  }
+  cache.view = MapViewOfFile(cache.mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!cache.view) {
+    closeBakeCache(cache);
+    return BakeCacheMatch::Missing;
+  }
+
+  const BakeCacheHeader* header =
+      static_cast<const BakeCacheHeader*>(cache.view);
+  if (header->magic != kBakeCacheMagic ||
+      header->version != kBakeCacheVersion || header->meshHash != meshHash ||
+      header->numVertices != numVertices) {
+    closeBakeCache(cache);
+    return BakeCacheMatch::Missing;
+  }
+  cache.radiances = reinterpret_cast<const HMM_Vec3*>(header + 1);
+
+  return header->settingsHash == settingsHash ? BakeCacheMatch::Exact
+                                              : BakeCacheMatch::Stale;
+}
+
+void closeBakeCache(BakeCache& cache) {
+  if (cache.view) {
+    UnmapViewOfFile(cache.view);
+  }
+  if (cache.mapping) {
+    CloseHandle(cache.mapping);
+  }
+  if (cache.file != INVALID_HANDLE_VALUE) {
+    CloseHandle(cache.file);
+  }
+  cache = {};
+}
+
+bool writeBakeCache(const char* fileName, uint64_t meshHash,
+                    uint64_t settingsHash, uint32_t numVertices,
+                    const HMM_Vec3* radiances) {
+  char tmpFileName[MAX_PATH];
+  snprintf(tmpFileName, MAX_PATH, "%s.tmp", fileName);
+  HANDLE hFile = CreateFileA(tmpFileName, GENERIC_WRITE, 0, NULL,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  BakeCacheHeader header;
+  header.meshHash = meshHash;
+  header.settingsHash = settingsHash;
+  header.numVertices = numVertices;
+  const DWORD radiancesSizeBytes = numVertices * sizeof(HMM_Vec3);
+  DWORD bytesWritten = 0;
+  const bool ok =
+      WriteFile(hFile, &header, sizeof(header), &bytesWritten, NULL) &&
+      bytesWritten == sizeof(header) &&
+      WriteFile(hFile, radiances, radiancesSizeBytes, &bytesWritten, NULL) &&
+      bytesWritten == radiancesSizeBytes;
+  CloseHandle(hFile);
+  if (!ok) {
+    DeleteFileA(tmpFileName);
+    return false;
+  }
+
+  return MoveFileExA(tmpFileName, fileName, MOVEFILE_REPLACE_EXISTING);
+}
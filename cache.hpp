@@ -0,0 +1,59 @@
+#pragma once
+
+#include "gather.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+
+// On-disk cache of converged radiances, stored next to the mesh file.
+// Layout: BakeCacheHeader followed by numVertices HMM_Vec3 radiances.
+constexpr uint32_t kBakeCacheMagic = 0x43494752;  // "RGIC"
+constexpr uint32_t kBakeCacheVersion = 1;
+
+struct BakeCacheHeader {
+  uint32_t magic{kBakeCacheMagic};
+  uint32_t version{kBakeCacheVersion};
+  // geometry only: positions, normals, indices and instance transforms
+  uint64_t meshHash{};
+  // emitted radiances and gather settings
+  uint64_t settingsHash{};
+  uint32_t numVertices{};
+  uint32_t padding{};
+};
+
+enum class BakeCacheMatch {
+  // no usable cache, bake from emission
+  Missing,
+  // same geometry but different lighting setup, only good as a preview while
+  // the bake runs
+  Stale,
+  // up-to-date, no need to bake
+  Exact,
+};
+
+// Read-only mapping of a cache file. radiances points into the mapped view.
+struct BakeCache {
+  HANDLE file{INVALID_HANDLE_VALUE};
+  HANDLE mapping{};
+  void* view{};
+  const HMM_Vec3* radiances{};
+};
+
+// FNV-1a, chained through `hash` so that several buffers can be combined.
+uint64_t hashBytes(const void* data, size_t numBytes,
+                   uint64_t hash = 0xcbf29ce484222325ull);
+uint64_t hashMeshGeometry(const Mesh& mesh);
+uint64_t hashSceneGeometry(const Scene& scene);
+// Same as hashSceneGeometry of makeSingleMeshScene for a mesh with that hash.
+uint64_t hashSingleMeshSceneGeometry(uint64_t meshHash);
+uint64_t hashBakeSettings(const GatherSettings& settings,
+                          const HMM_Vec3* emission, uint32_t numVertices);
+
+BakeCacheMatch openBakeCache(const char* fileName, uint64_t meshHash,
+                             uint64_t settingsHash, uint32_t numVertices,
+                             BakeCache& cache);
+void closeBakeCache(BakeCache& cache);
+// Writes into a temporary file first and then replaces the cache, so that a
+// crash during write never leaves a truncated cache behind.
+bool writeBakeCache(const char* fileName, uint64_t meshHash,
+                    uint64_t settingsHash, uint32_t numVertices,
+                    const HMM_Vec3* radiances);
@@ -0,0 +1,689 @@
+#include "chunked.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+bool readFileAt(HANDLE file, uint64_t offset, void* data, DWORD numBytes) {
+  LARGE_INTEGER pos;
+  pos.QuadPart = static_cast<LONGLONG>(offset);
+  DWORD bytesRead = 0;
+  return SetFilePointerEx(file, pos, NULL, FILE_BEGIN) &&
+         ReadFile(file, data, numBytes, &bytesRead, NULL) &&
+         bytesRead == numBytes;
+}
+
+bool writeFileAt(HANDLE file, uint64_t offset, const void* data,
+                 DWORD numBytes) {
+  LARGE_INTEGER pos;
+  pos.QuadPart = static_cast<LONGLONG>(offset);
+  DWORD bytesWritten = 0;
+  return SetFilePointerEx(file, pos, NULL, FILE_BEGIN) &&
+         WriteFile(file, data, numBytes, &bytesWritten, NULL) &&
+         bytesWritten == numBytes;
+}
+
+namespace {
+struct ChunkBuilder {
+  const Mesh* mesh;
+  uint32_t maxChunkTriangles;
+  // triangle indices, reordered so that each chunk is a contiguous range
+  uint32_t* triangles;
+  HMM_Vec3* centroids;
+  // [first, first + count) ranges of triangles, in depth-first order
+  uint32_t numChunks;
+  uint32_t* chunkFirstTriangle;
+  uint32_t* chunkNumTriangles;
+};
+}  // namespace
+
+static void splitTriangles(ChunkBuilder& b, uint32_t first, uint32_t count) {
+  if (count <= b.maxChunkTriangles) {
+    b.chunkFirstTriangle[b.numChunks] = first;
+    b.chunkNumTriangles[b.numChunks] = count;
+    ++b.numChunks;
+    return;
+  }
+
+  HMM_Vec3 boundsMin = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+  HMM_Vec3 boundsMax = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (uint32_t i = first; i < first + count; ++i) {
+    const HMM_Vec3& c = b.centroids[b.triangles[i]];
+    for (int a = 0; a < 3; ++a) {
+      boundsMin[a] = HMM_MIN(boundsMin[a], c.Elements[a]);
+      boundsMax[a] = HMM_MAX(boundsMax[a], c.Elements[a]);
+    }
+  }
+  const HMM_Vec3 extent = boundsMax - boundsMin;
+  const int axis = extent.X > extent.Y ? (extent.X > extent.Z ? 0 : 2)
+                                       : (extent.Y > extent.Z ? 1 : 2);
+
+  const uint32_t half = count / 2;
+  uint32_t* tris = b.triangles + first;
+  std::nth_element(tris, tris + half, tris + count,
+                   [&b, axis](uint32_t lhs, uint32_t rhs) {
+                     return b.centroids[lhs].Elements[axis] <
+                            b.centroids[rhs].Elements[axis];
+                   });
+
+  splitTriangles(b, first, half);
+  splitTriangles(b, first + half, count - half);
+}
+
+// Number of chunks splitTriangles makes out of numTriangles triangles.
+static uint32_t countChunks(uint32_t numTriangles, uint32_t maxChunkTriangles) {
+  if (numTriangles <= maxChunkTriangles) {
+    return 1;
+  }
+  const uint32_t half = numTriangles / 2;
+  return countChunks(half, maxChunkTriangles) +
+         countChunks(numTriangles - half, maxChunkTriangles);
+}
+
+// Splits `mesh` into chunks and writes them at fileOffset, appending their
+// entries to `chunks` and their sizes to the header.
+static void writeMeshChunks(const Mesh& mesh, uint32_t maxChunkTriangles,
+                            HANDLE hFile, ChunkedMeshHeader& header,
+                            MeshChunk* chunks, uint64_t& fileOffset) {
+  const uint32_t numTriangles = mesh.numIndices / 3;
+  ChunkBuilder b{};
+  b.mesh = &mesh;
+  b.maxChunkTriangles = maxChunkTriangles;
+  b.triangles = new uint32_t[numTriangles];
+  b.centroids = new HMM_Vec3[numTriangles];
+  b.chunkFirstTriangle = new uint32_t[countChunks(numTriangles, maxChunkTriangles)];
+  b.chunkNumTriangles = new uint32_t[countChunks(numTriangles, maxChunkTriangles)];
+  for (uint32_t triIx = 0; triIx < numTriangles; ++triIx) {
+    b.triangles[triIx] = triIx;
+    const unsigned int* tri = mesh.indices + 3 * triIx;
+    b.centroids[triIx] = (mesh.positions[tri[0]] + mesh.positions[tri[1]] +
+                          mesh.positions[tri[2]]) /
+                         3.f;
+  }
+  splitTriangles(b, 0, numTriangles);
+
+  // maps mesh vertex to chunk vertex, UINT32_MAX when not in current chunk
+  uint32_t* chunkVertIxs = new uint32_t[mesh.numVertices];
+  for (uint32_t vertIx = 0; vertIx < mesh.numVertices; ++vertIx) {
+    chunkVertIxs[vertIx] = UINT32_MAX;
+  }
+  const uint32_t maxChunkVertices = 3 * HMM_MIN(maxChunkTriangles, numTriangles);
+  uint32_t* meshVertIxs = new uint32_t[maxChunkVertices];
+  HMM_Vec3* attr = new HMM_Vec3[maxChunkVertices];
+  unsigned int* indices = new unsigned int[maxChunkVertices];
+  for (uint32_t builtIx = 0; builtIx < b.numChunks; ++builtIx) {
+    MeshChunk& chunk = chunks[header.numChunks++];
+    chunk.boundsMin = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+    chunk.boundsMax = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    chunk.firstVertex = header.numVertices;
+    chunk.fileOffset = fileOffset;
+    const uint32_t firstTri = b.chunkFirstTriangle[builtIx];
+    for (uint32_t i = 0; i < b.chunkNumTriangles[builtIx]; ++i) {
+      const unsigned int* tri = mesh.indices + 3 * b.triangles[firstTri + i];
+      for (int k = 0; k < 3; ++k) {
+        const uint32_t vertIx = tri[k];
+        if (chunkVertIxs[vertIx] == UINT32_MAX) {
+          chunkVertIxs[vertIx] = chunk.numVertices;
+          meshVertIxs[chunk.numVertices++] = vertIx;
+          const HMM_Vec3& p = mesh.positions[vertIx];
+          for (int a = 0; a < 3; ++a) {
+            chunk.boundsMin[a] = HMM_MIN(chunk.boundsMin[a], p.Elements[a]);
+            chunk.boundsMax[a] = HMM_MAX(chunk.boundsMax[a], p.Elements[a]);
+          }
+        }
+        indices[chunk.numIndices++] = chunkVertIxs[vertIx];
+      }
+    }
+
+    const DWORD attrSizeBytes = chunk.numVertices * sizeof(HMM_Vec3);
+    for (const HMM_Vec3* meshAttr :
+         {mesh.positions, mesh.normals, mesh.colors}) {
+      for (uint32_t i = 0; i < chunk.numVertices; ++i) {
+        attr[i] = meshAttr[meshVertIxs[i]];
+      }
+      if (!writeFileAt(hFile, fileOffset, attr, attrSizeBytes)) {
+        fatal("Failed to write chunk vertex data.");
+      }
+      fileOffset += attrSizeBytes;
+    }
+    const DWORD indicesSizeBytes = chunk.numIndices * sizeof(unsigned int);
+    if (!writeFileAt(hFile, fileOffset, indices, indicesSizeBytes)) {
+      fatal("Failed to write chunk index data.");
+    }
+    fileOffset += indicesSizeBytes;
+
+    for (uint32_t i = 0; i < chunk.numVertices; ++i) {
+      chunkVertIxs[meshVertIxs[i]] = UINT32_MAX;
+    }
+    header.numVertices += chunk.numVertices;
+    header.numIndices += chunk.numIndices;
+  }
+
+  delete[] indices;
+  delete[] attr;
+  delete[] meshVertIxs;
+  delete[] chunkVertIxs;
+  delete[] b.chunkNumTriangles;
+  delete[] b.chunkFirstTriangle;
+  delete[] b.centroids;
+  delete[] b.triangles;
+}
+
+// vertices or triangles read from the mesh file at once
+constexpr uint32_t kConvertBlockSize = 1 << 16;
+// upper bound of grid cells, each costs 12 bytes
+constexpr uint32_t kMaxGridCells = 1 << 22;
+// cells per axis when a cell that does not fit into memory is binned again
+constexpr uint32_t kSubGridSide = 4;
+
+namespace {
+// Triangle in the temporary file, with the position of its first vertex so
+// that it can be binned again without reading the mesh.
+struct TriangleRecord {
+  unsigned int indices[3];
+  HMM_Vec3 position;
+};
+
+struct BinnedTriangle {
+  uint32_t cellIx;
+  TriangleRecord tri;
+};
+
+struct ConvertGrid {
+  HMM_Vec3 boundsMin;
+  double cellSide[3];
+  uint32_t size[3];
+};
+
+// [first, first + count) records of the temporary file
+struct TriangleRun {
+  uint64_t first;
+  uint32_t count;
+};
+
+struct RunSplitter {
+  HANDLE binFile;
+  // records in the temporary file, runs binned again are appended
+  uint64_t numRecords;
+  uint32_t maxChunkTriangles;
+  uint64_t memoryCapBytes;
+  // kConvertBlockSize each
+  TriangleRecord* records;
+  BinnedTriangle* binned;
+  // runs that can be chunked in memory, in file order
+  TriangleRun* leaves;
+  uint32_t numLeaves;
+  uint32_t leafCapacity;
+};
+}  // namespace
+
+static uint32_t getGridCellIx(const ConvertGrid& grid, const HMM_Vec3& p) {
+  uint32_t cell[3];
+  for (int a = 0; a < 3; ++a) {
+    const double c =
+        grid.size[a] > 1
+            ? (p.Elements[a] - grid.boundsMin.Elements[a]) / grid.cellSide[a]
+            : 0.0;
+    cell[a] = HMM_MIN(static_cast<uint32_t>(HMM_MAX(c, 0.0)), grid.size[a] - 1);
+  }
+  return (cell[2] * grid.size[1] + cell[1]) * grid.size[0] + cell[0];
+}
+
+// Memory to chunk a run of numTriangles in memory: the cell mesh with its
+// vertex ids, the arrays of writeMeshChunks and the record block.
+static uint64_t getRunWorkingSetBytes(uint32_t numTriangles,
+                                      uint32_t maxChunkTriangles) {
+  const uint64_t numCorners = 3 * uint64_t{numTriangles};
+  const uint64_t numChunkCorners =
+      3 * uint64_t{HMM_MIN(maxChunkTriangles, numTriangles)};
+  return numCorners * (2 * sizeof(unsigned int) + 3 * sizeof(HMM_Vec3)) +
+         uint64_t{numTriangles} * (sizeof(uint32_t) + sizeof(HMM_Vec3)) +
+         numCorners * sizeof(uint32_t) +
+         numChunkCorners * (2 * sizeof(uint32_t) + sizeof(HMM_Vec3)) +
+         kConvertBlockSize * sizeof(TriangleRecord);
+}
+
+static void readTriangleRecords(HANDLE binFile, uint64_t first, uint32_t count,
+                                TriangleRecord* records) {
+  if (!readFileAt(binFile, first * sizeof(TriangleRecord), records,
+                  count * sizeof(TriangleRecord))) {
+    fatal("Failed to read temporary triangle file.");
+  }
+}
+
+// Sorts a block of binned triangles by cell and writes each cell's run at
+// its cursor.
+static void writeBinnedTriangles(HANDLE binFile, BinnedTriangle* tris,
+                                 uint32_t numBinned, uint64_t* cellCursors,
+                                 TriangleRecord* records) {
+  std::sort(tris, tris + numBinned,
+            [](const BinnedTriangle& lhs, const BinnedTriangle& rhs) {
+              return lhs.cellIx < rhs.cellIx;
+            });
+  uint32_t runFirst = 0;
+  while (runFirst < numBinned) {
+    const uint32_t cellIx = tris[runFirst].cellIx;
+    uint32_t runEnd = runFirst;
+    while (runEnd < numBinned && tris[runEnd].cellIx == cellIx) {
+      records[runEnd - runFirst] = tris[runEnd].tri;
+      ++runEnd;
+    }
+    const uint32_t runSize = runEnd - runFirst;
+    if (!writeFileAt(binFile, cellCursors[cellIx] * sizeof(TriangleRecord),
+                     records, runSize * sizeof(TriangleRecord))) {
+      fatal("Failed to write temporary triangle file.");
+    }
+    cellCursors[cellIx] += runSize;
+    runFirst = runEnd;
+  }
+}
+
+// Splits a run until every part can be chunked in memory. Runs are binned
+// again into a finer grid over their bounds, or halved when their triangles
+// do not spread over it.
+static void splitTriangleRun(RunSplitter& s, TriangleRun run) {
+  if (getRunWorkingSetBytes(run.count, s.maxChunkTriangles) <=
+      s.memoryCapBytes) {
+    if (s.numLeaves == s.leafCapacity) {
+      s.leafCapacity = HMM_MAX(2 * s.leafCapacity, 64u);
+      TriangleRun* leaves = new TriangleRun[s.leafCapacity];
+      memcpy(leaves, s.leaves, s.numLeaves * sizeof(TriangleRun));
+      delete[] s.leaves;
+      s.leaves = leaves;
+    }
+    s.leaves[s.numLeaves++] = run;
+    return;
+  }
+  if (run.count == 1) {
+    fatal("The memory cap is too small to convert a single triangle.");
+  }
+
+  // calls visit(records, count) for every block of the run
+  auto forEachBlock = [&s, run](auto&& visit) {
+    for (uint32_t done = 0; done < run.count; done += kConvertBlockSize) {
+      const uint32_t count = HMM_MIN(kConvertBlockSize, run.count - done);
+      readTriangleRecords(s.binFile, run.first + done, count, s.records);
+      visit(s.records, count);
+    }
+  };
+  ConvertGrid grid;
+  grid.boundsMin = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+  HMM_Vec3 boundsMax = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  forEachBlock([&](const TriangleRecord* records, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+      for (int a = 0; a < 3; ++a) {
+        grid.boundsMin[a] =
+            HMM_MIN(grid.boundsMin[a], records[i].position.Elements[a]);
+        boundsMax[a] = HMM_MAX(boundsMax[a], records[i].position.Elements[a]);
+      }
+    }
+  });
+  for (int a = 0; a < 3; ++a) {
+    const double extent = boundsMax.Elements[a] - grid.boundsMin.Elements[a];
+    grid.size[a] = extent > 0.0 ? kSubGridSide : 1;
+    grid.cellSide[a] = extent / grid.size[a];
+  }
+  constexpr uint32_t kNumSubCells = kSubGridSide * kSubGridSide * kSubGridSide;
+  uint32_t cellNumTriangles[kNumSubCells]{};
+  forEachBlock([&](const TriangleRecord* records, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+      ++cellNumTriangles[getGridCellIx(grid, records[i].position)];
+    }
+  });
+  bool isSpread = true;
+  for (uint32_t cellIx = 0; cellIx < kNumSubCells; ++cellIx) {
+    isSpread = isSpread && cellNumTriangles[cellIx] < run.count;
+  }
+  if (!isSpread) {
+    const uint32_t half = run.count / 2;
+    splitTriangleRun(s, {run.first, half});
+    splitTriangleRun(s, {run.first + half, run.count - half});
+    return;
+  }
+
+  uint64_t cellCursors[kNumSubCells];
+  cellCursors[0] = s.numRecords;
+  for (uint32_t cellIx = 1; cellIx < kNumSubCells; ++cellIx) {
+    cellCursors[cellIx] = cellCursors[cellIx - 1] + cellNumTriangles[cellIx - 1];
+  }
+  const uint64_t subFirst = s.numRecords;
+  s.numRecords += run.count;
+  forEachBlock([&](const TriangleRecord* records, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+      s.binned[i].cellIx = getGridCellIx(grid, records[i].position);
+      s.binned[i].tri = records[i];
+    }
+    // the block is copied to binned, records serves as scratch
+    writeBinnedTriangles(s.binFile, s.binned, count, cellCursors, s.records);
+  });
+  uint64_t cellFirst = subFirst;
+  for (uint32_t cellIx = 0; cellIx < kNumSubCells; ++cellIx) {
+    if (cellNumTriangles[cellIx] > 0) {
+      splitTriangleRun(s, {cellFirst, cellNumTriangles[cellIx]});
+    }
+    cellFirst += cellNumTriangles[cellIx];
+  }
+}
+
+void writeChunkedMeshFromFile(const char* meshFileName, const char* fileName,
+                              uint32_t maxChunkTriangles,
+                              uint64_t memoryCapBytes) {
+  HANDLE meshFile = CreateFileA(meshFileName, GENERIC_READ, FILE_SHARE_READ,
+                                NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (meshFile == INVALID_HANDLE_VALUE) {
+    fatal("Failed to open mesh file.");
+  }
+  // numVertices and numIndices, see readMeshFromFile for the layout
+  unsigned int counts[2];
+  if (!readFileAt(meshFile, 0, counts, sizeof(counts))) {
+    fatal("Failed to read mesh file header.");
+  }
+  const uint32_t numVertices = counts[0];
+  const uint32_t numTriangles = counts[1] / 3;
+  maxChunkTriangles = HMM_MAX(maxChunkTriangles, 1u);
+  auto getAttrOffset = [numVertices](uint32_t attrIx, uint32_t vertIx) {
+    return sizeof(counts) +
+           (uint64_t{attrIx} * numVertices + vertIx) * sizeof(HMM_Vec3);
+  };
+  auto getTriangleOffset = [&getAttrOffset](uint32_t triIx) {
+    return getAttrOffset(3, 0) + uint64_t{triIx} * 3 * sizeof(unsigned int);
+  };
+
+  HMM_Vec3* positions = new HMM_Vec3[kConvertBlockSize];
+  HMM_Vec3 boundsMin = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+  HMM_Vec3 boundsMax = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (uint32_t first = 0; first < numVertices; first += kConvertBlockSize) {
+    const uint32_t count = HMM_MIN(kConvertBlockSize, numVertices - first);
+    if (!readFileAt(meshFile, getAttrOffset(0, first), positions,
+                    count * sizeof(HMM_Vec3))) {
+      fatal("Failed to read mesh positions.");
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      for (int a = 0; a < 3; ++a) {
+        boundsMin[a] = HMM_MIN(boundsMin[a], positions[i].Elements[a]);
+        boundsMax[a] = HMM_MAX(boundsMax[a], positions[i].Elements[a]);
+      }
+    }
+  }
+  delete[] positions;
+
+  // Triangles are binned into a uniform grid by their first vertex. The grid
+  // has about 16 cells per chunk, surfaces leave most of them empty. Cells
+  // that do not fit into memoryCapBytes are binned again, the rest are split
+  // into chunks in memory.
+  const HMM_Vec3 extent = boundsMax - boundsMin;
+  const float maxExtent = HMM_MAX(HMM_MAX(extent.X, extent.Y), extent.Z);
+  const float minExtent = HMM_MAX(maxExtent * 1e-3f, 1e-6f);
+  const double targetNumCells = HMM_MIN(
+      16.0 * numTriangles / maxChunkTriangles + 1, double{kMaxGridCells});
+  const double cellSide = std::cbrt(double{HMM_MAX(extent.X, minExtent)} *
+                                    HMM_MAX(extent.Y, minExtent) *
+                                    HMM_MAX(extent.Z, minExtent) /
+                                    targetNumCells);
+  ConvertGrid grid;
+  grid.boundsMin = boundsMin;
+  for (int a = 0; a < 3; ++a) {
+    grid.cellSide[a] = cellSide;
+    grid.size[a] = static_cast<uint32_t>(
+        HMM_MAX(std::round(extent.Elements[a] / cellSide), 1.0));
+  }
+  const uint32_t numCells = grid.size[0] * grid.size[1] * grid.size[2];
+
+  // Positions of a window of vertices are known at once, the index list is
+  // read once per window, so a cap below 24 bytes per vertex costs extra
+  // passes.
+  const uint32_t windowSize = static_cast<uint32_t>(HMM_MIN(
+      HMM_MAX(memoryCapBytes / 2 / sizeof(HMM_Vec3),
+              uint64_t{kConvertBlockSize}),
+      uint64_t{HMM_MAX(numVertices, 1u)}));
+  HMM_Vec3* windowPositions = new HMM_Vec3[windowSize];
+  unsigned int* triangleBlock = new unsigned int[3 * kConvertBlockSize];
+  TriangleRecord* records = new TriangleRecord[kConvertBlockSize];
+  BinnedTriangle* binned = new BinnedTriangle[kConvertBlockSize];
+  // calls binBlock(binned, numBinned) for every block of triangles, each
+  // triangle once
+  auto binTriangles = [&](auto&& binBlock) {
+    for (uint32_t windowFirst = 0; windowFirst < numVertices;
+         windowFirst += windowSize) {
+      const uint32_t windowEnd =
+          windowFirst + HMM_MIN(windowSize, numVertices - windowFirst);
+      if (!readFileAt(meshFile, getAttrOffset(0, windowFirst),
+                      windowPositions,
+                      (windowEnd - windowFirst) * sizeof(HMM_Vec3))) {
+        fatal("Failed to read mesh positions.");
+      }
+      for (uint32_t first = 0; first < numTriangles;
+           first += kConvertBlockSize) {
+        const uint32_t count = HMM_MIN(kConvertBlockSize, numTriangles - first);
+        if (!readFileAt(meshFile, getTriangleOffset(first), triangleBlock,
+                        count * 3 * sizeof(unsigned int))) {
+          fatal("Failed to read mesh indices.");
+        }
+        uint32_t numBinned = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+          const unsigned int* tri = triangleBlock + 3 * i;
+          if (tri[0] >= numVertices || tri[1] >= numVertices ||
+              tri[2] >= numVertices) {
+            fatal("Mesh index out of range.");
+          }
+          if (tri[0] < windowFirst || tri[0] >= windowEnd) {
+            continue;
+          }
+          BinnedTriangle& t = binned[numBinned++];
+          memcpy(t.tri.indices, tri, sizeof(t.tri.indices));
+          t.tri.position = windowPositions[tri[0] - windowFirst];
+          t.cellIx = getGridCellIx(grid, t.tri.position);
+        }
+        binBlock(binned, numBinned);
+      }
+    }
+  };
+
+  // counting sort of the triangles by cell into a temporary file
+  uint32_t* cellNumTriangles = new uint32_t[numCells]{};
+  uint64_t* cellCursors = new uint64_t[numCells];
+  binTriangles([&](const BinnedTriangle* tris, uint32_t numBinned) {
+    for (uint32_t i = 0; i < numBinned; ++i) {
+      ++cellNumTriangles[tris[i].cellIx];
+    }
+  });
+  uint64_t numBinnedTriangles = 0;
+  for (uint32_t cellIx = 0; cellIx < numCells; ++cellIx) {
+    cellCursors[cellIx] = numBinnedTriangles;
+    numBinnedTriangles += cellNumTriangles[cellIx];
+  }
+
+  char binPath[MAX_PATH];
+  snprintf(binPath, MAX_PATH, "%s.tris.tmp", fileName);
+  HANDLE binFile = CreateFileA(binPath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                               CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+  if (binFile == INVALID_HANDLE_VALUE) {
+    fatal("Failed to create temporary triangle file.");
+  }
+  binTriangles([&](BinnedTriangle* tris, uint32_t numBinned) {
+    writeBinnedTriangles(binFile, tris, numBinned, cellCursors, records);
+  });
+  delete[] windowPositions;
+  delete[] triangleBlock;
+
+  RunSplitter s{};
+  s.binFile = binFile;
+  s.numRecords = numBinnedTriangles;
+  s.maxChunkTriangles = maxChunkTriangles;
+  s.memoryCapBytes = memoryCapBytes;
+  s.records = records;
+  s.binned = binned;
+  uint64_t cellFirst = 0;
+  for (uint32_t cellIx = 0; cellIx < numCells; ++cellIx) {
+    if (cellNumTriangles[cellIx] > 0) {
+      splitTriangleRun(s, {cellFirst, cellNumTriangles[cellIx]});
+    }
+    cellFirst += cellNumTriangles[cellIx];
+  }
+  delete[] binned;
+  delete[] cellCursors;
+  delete[] cellNumTriangles;
+  uint32_t maxLeafTriangles = 0;
+  uint32_t numChunks = 0;
+  for (uint32_t leafIx = 0; leafIx < s.numLeaves; ++leafIx) {
+    maxLeafTriangles = HMM_MAX(maxLeafTriangles, s.leaves[leafIx].count);
+    numChunks += countChunks(s.leaves[leafIx].count, maxChunkTriangles);
+  }
+
+  HANDLE hFile = CreateFileA(fileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    fatal("Failed to create chunked mesh file.");
+  }
+  ChunkedMeshHeader header;
+  MeshChunk* chunks = new MeshChunk[numChunks];
+  uint64_t fileOffset =
+      sizeof(ChunkedMeshHeader) + sizeof(MeshChunk) * uint64_t{numChunks};
+
+  // one run at a time as a mesh of its own, chunks of neighboring cells end
+  // up close in the file
+  Mesh cell;
+  cell.indices = new unsigned int[3 * maxLeafTriangles];
+  uint32_t* cellVertIxs = new uint32_t[3 * maxLeafTriangles];
+  cell.positions = new HMM_Vec3[3 * maxLeafTriangles];
+  cell.normals = new HMM_Vec3[3 * maxLeafTriangles];
+  cell.colors = new HMM_Vec3[3 * maxLeafTriangles];
+  for (uint32_t leafIx = 0; leafIx < s.numLeaves; ++leafIx) {
+    const TriangleRun& leaf = s.leaves[leafIx];
+    cell.numIndices = 3 * leaf.count;
+    for (uint32_t done = 0; done < leaf.count; done += kConvertBlockSize) {
+      const uint32_t count = HMM_MIN(kConvertBlockSize, leaf.count - done);
+      readTriangleRecords(binFile, leaf.first + done, count, records);
+      for (uint32_t i = 0; i < count; ++i) {
+        memcpy(cell.indices + 3 * (done + i), records[i].indices,
+               sizeof(records[i].indices));
+      }
+    }
+
+    // mesh vertices of the cell in file order, read in contiguous runs
+    memcpy(cellVertIxs, cell.indices, cell.numIndices * sizeof(unsigned int));
+    std::sort(cellVertIxs, cellVertIxs + cell.numIndices);
+    cell.numVertices = static_cast<unsigned int>(
+        std::unique(cellVertIxs, cellVertIxs + cell.numIndices) - cellVertIxs);
+    HMM_Vec3* cellAttrs[] = {cell.positions, cell.normals, cell.colors};
+    for (uint32_t attrIx = 0; attrIx < 3; ++attrIx) {
+      uint32_t runFirst = 0;
+      while (runFirst < cell.numVertices) {
+        uint32_t runEnd = runFirst + 1;
+        while (runEnd < cell.numVertices &&
+               cellVertIxs[runEnd] == cellVertIxs[runEnd - 1] + 1) {
+          ++runEnd;
+        }
+        if (!readFileAt(meshFile, getAttrOffset(attrIx, cellVertIxs[runFirst]),
+                        cellAttrs[attrIx] + runFirst,
+                        (runEnd - runFirst) * sizeof(HMM_Vec3))) {
+          fatal("Failed to read mesh vertex data.");
+        }
+        runFirst = runEnd;
+      }
+    }
+    for (uint32_t i = 0; i < cell.numVertices; ++i) {
+      // same intensity boost as readMeshFromFile
+      cell.colors[i] *= 4;
+    }
+    for (uint32_t i = 0; i < cell.numIndices; ++i) {
+      cell.indices[i] = static_cast<unsigned int>(
+          std::lower_bound(cellVertIxs, cellVertIxs + cell.numVertices,
+                           cell.indices[i]) -
+          cellVertIxs);
+    }
+    writeMeshChunks(cell, maxChunkTriangles, hFile, header, chunks,
+                    fileOffset);
+  }
+
+  if (!writeFileAt(hFile, 0, &header, sizeof(header)) ||
+      !writeFileAt(hFile, sizeof(header), chunks,
+                   sizeof(MeshChunk) * header.numChunks)) {
+    fatal("Failed to write chunked mesh header.");
+  }
+  CloseHandle(hFile);
+  CloseHandle(binFile);
+  DeleteFileA(binPath);
+  CloseHandle(meshFile);
+
+  delete[] cell.colors;
+  delete[] cell.normals;
+  delete[] cell.positions;
+  delete[] cellVertIxs;
+  delete[] cell.indices;
+  delete[] chunks;
+  delete[] s.leaves;
+  delete[] records;
+}
+
+ChunkedMesh openChunkedMesh(const char* fileName) {
+  ChunkedMesh cmesh;
+  cmesh.file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (cmesh.file == INVALID_HANDLE_VALUE) {
+    fatal("Failed to open chunked mesh file");
+  }
+  if (!readFileAt(cmesh.file, 0, &cmesh.header, sizeof(cmesh.header)) ||
+      cmesh.header.magic != kChunkedMeshMagic ||
+      cmesh.header.version != kChunkedMeshVersion) {
+    fatal("Not a chunked mesh file or unsupported version.");
+  }
+  cmesh.chunks = new MeshChunk[cmesh.header.numChunks];
+  if (!readFileAt(cmesh.file, sizeof(cmesh.header), cmesh.chunks,
+                  sizeof(MeshChunk) * cmesh.header.numChunks)) {
+    fatal("Failed to read chunk table.");
+  }
+  return cmesh;
+}
+
+void closeChunkedMesh(ChunkedMesh& cmesh) {
+  if (cmesh.file != INVALID_HANDLE_VALUE) {
+    CloseHandle(cmesh.file);
+  }
+  delete[] cmesh.chunks;
+  cmesh = {};
+}
+
+void readMeshChunk(const ChunkedMesh& cmesh, uint32_t chunkIx,
+                   HMM_Vec3* positions, HMM_Vec3* normals, HMM_Vec3* colors,
+                   unsigned int* indices) {
+  const MeshChunk& chunk = cmesh.chunks[chunkIx];
+  const DWORD attrSizeBytes = chunk.numVertices * sizeof(HMM_Vec3);
+  uint64_t offset = chunk.fileOffset;
+  for (HMM_Vec3* attr : {positions, normals, colors}) {
+    if (attr && !readFileAt(cmesh.file, offset, attr, attrSizeBytes)) {
+      fatal("Failed to read chunk vertex data.");
+    }
+    offset += attrSizeBytes;
+  }
+  if (indices && !readFileAt(cmesh.file, offset, indices,
+                             chunk.numIndices * sizeof(unsigned int))) {
+    fatal("Failed to read chunk index data.");
+  }
+}
+
+Mesh readChunkedMeshFromFile(const char* fileName) {
+  ChunkedMesh cmesh = openChunkedMesh(fileName);
+  Mesh mesh;
+  mesh.numVertices = cmesh.header.numVertices;
+  mesh.numIndices = cmesh.header.numIndices;
+  mesh.positions = new HMM_Vec3[mesh.numVertices];
+  mesh.normals = new HMM_Vec3[mesh.numVertices];
+  mesh.colors = new HMM_Vec3[mesh.numVertices];
+  mesh.indices = new unsigned int[mesh.numIndices];
+  uint32_t firstIndex = 0;
+  for (uint32_t chunkIx = 0; chunkIx < cmesh.header.numChunks; ++chunkIx) {
+    const MeshChunk& chunk = cmesh.chunks[chunkIx];
+    readMeshChunk(cmesh, chunkIx, mesh.positions + chunk.firstVertex,
+                  mesh.normals + chunk.firstVertex,
+                  mesh.colors + chunk.firstVertex, mesh.indices + firstIndex);
+    for (uint32_t i = firstIndex; i < firstIndex + chunk.numIndices; ++i) {
+      mesh.indices[i] += chunk.firstVertex;
+    }
+    firstIndex += chunk.numIndices;
+  }
+  closeChunkedMesh(cmesh);
+  return mesh;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "mesh.hpp"
+#include "opengl.hpp"
+
+// Spatially partitioned mesh for scenes that do not fit into memory.
+// Layout: ChunkedMeshHeader, numChunks MeshChunk entries, then per chunk
+// positions, normals, colors (numVertices HMM_Vec3 each) and indices
+// (numIndices, local to the chunk). Vertices on chunk borders are duplicated
+// so that every chunk can be drawn on its own.
+constexpr uint32_t kChunkedMeshMagic = 0x4D434752;  // "RGCM"
+constexpr uint32_t kChunkedMeshVersion = 1;
+
+struct ChunkedMeshHeader {
+  uint32_t magic{kChunkedMeshMagic};
+  uint32_t version{kChunkedMeshVersion};
+  uint32_t numChunks{};
+  // sums over all chunks
+  uint32_t numVertices{};
+  uint32_t numIndices{};
+  uint32_t padding{};
+};
+
+struct MeshChunk {
+  HMM_Vec3 boundsMin{};
+  HMM_Vec3 boundsMax{};
+  uint32_t numVertices{};
+  uint32_t numIndices{};
+  // offset of this chunk's vertices when all chunks are concatenated
+  uint32_t firstVertex{};
+  uint32_t padding{};
+  uint64_t fileOffset{};
+};
+
+// Header and chunk table of an opened chunked mesh, geometry stays on disk.
+struct ChunkedMesh {
+  HANDLE file{INVALID_HANDLE_VALUE};
+  ChunkedMeshHeader header;
+  MeshChunk* chunks{};
+};
+
+bool readFileAt(HANDLE file, uint64_t offset, void* data, DWORD numBytes);
+bool writeFileAt(HANDLE file, uint64_t offset, const void* data,
+                 DWORD numBytes);
+
+// Converts a .mesh file without loading it. Triangles are binned into a
+// coarse grid through a temporary <fileName>.tris.tmp, then each grid cell is
+// split at the median of its triangle centroids along the longest axis until
+// every chunk has at most maxChunkTriangles. Chunks are written in depth-first
+// order so that neighboring chunks are close in the file. Cells that cannot be
+// split in memoryCapBytes are binned again into finer grids first.
+void writeChunkedMeshFromFile(const char* meshFileName, const char* fileName,
+                              uint32_t maxChunkTriangles,
+                              uint64_t memoryCapBytes);
+
+ChunkedMesh openChunkedMesh(const char* fileName);
+void closeChunkedMesh(ChunkedMesh& cmesh);
+// Reads the attributes of one chunk, pass null for attributes not needed.
+void readMeshChunk(const ChunkedMesh& cmesh, uint32_t chunkIx,
+                   HMM_Vec3* positions, HMM_Vec3* normals, HMM_Vec3* colors,
+                   unsigned int* indices);
+// Loads all chunks into a single mesh, vertices in chunk order.
+Mesh readChunkedMeshFromFile(const char* fileName);
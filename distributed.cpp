@@ -0,0 +1,354 @@
+#include "distributed.hpp"
+#include "cache.hpp"
+
+#include <cstdio>
+#include <print>
+#include <thread>
+
+static LONG getUnitDoneState(LONG iteration) { return -(iteration + 1); }
+
+static bool isUnitPending(LONG state, LONG iteration) {
+  return state <= 0 && state != getUnitDoneState(iteration);
+}
+
+// keeps the radiance arrays 16 byte aligned
+static uint64_t getUnitStatesSizeBytes(uint32_t numUnits) {
+  return (sizeof(LONG) * uint64_t{numUnits} + 15) & ~15ull;
+}
+
+static uint64_t getSharedBakeSizeBytes(uint32_t numVertices,
+                                       uint32_t numUnits) {
+  return sizeof(SharedBakeHeader) + getUnitStatesSizeBytes(numUnits) +
+         2 * sizeof(HMM_Vec3) * uint64_t{numVertices};
+}
+
+// Maps the whole file when sizeBytes is 0, otherwise grows it to sizeBytes.
+static void mapSharedBake(SharedBake& bake, uint64_t sizeBytes) {
+  bake.mapping = CreateFileMappingA(bake.file, NULL, PAGE_READWRITE,
+                                    static_cast<DWORD>(sizeBytes >> 32),
+                                    static_cast<DWORD>(sizeBytes), NULL);
+  if (!bake.mapping) {
+    fatal("Failed to map shared bake file.");
+  }
+  bake.view = MapViewOfFile(bake.mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+  if (!bake.view) {
+    fatal("Failed to map view of shared bake file.");
+  }
+  bake.header = static_cast<SharedBakeHeader*>(bake.view);
+}
+
+// Points into the mapped view according to the sizes in the header.
+static void locateSharedBakeArrays(SharedBake& bake) {
+  bake.unitStates = reinterpret_cast<volatile LONG*>(bake.header + 1);
+  bake.radiances[0] = reinterpret_cast<HMM_Vec3*>(
+      reinterpret_cast<char*>(bake.header + 1) +
+      getUnitStatesSizeBytes(bake.header->numUnits));
+  bake.radiances[1] = bake.radiances[0] + bake.header->numVertices;
+}
+
+static void closeSharedBake(SharedBake& bake) {
+  if (bake.view) {
+    UnmapViewOfFile(bake.view);
+  }
+  if (bake.mapping) {
+    CloseHandle(bake.mapping);
+  }
+  if (bake.file != INVALID_HANDLE_VALUE) {
+    CloseHandle(bake.file);
+  }
+  bake = {};
+}
+
+static HANDLE openSharedBakeFile(const char* fileName) {
+  return CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE,
+                     FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS,
+                     FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+// Opens the bake file and resumes it when it belongs to the same bake,
+// otherwise starts over from the emission.
+static void openOrCreateSharedBake(const char* fileName, const Scene& scene,
+                                   const GatherSettings& settings,
+                                   uint32_t unitSize, SharedBake& bake) {
+  HMM_Vec3* emission = new HMM_Vec3[scene.numVertices];
+  copySceneEmission(scene, emission);
+  SharedBakeHeader expected;
+  expected.meshHash = hashSceneGeometry(scene);
+  expected.settingsHash =
+      hashBakeSettings(settings, emission, scene.numVertices);
+  expected.numVertices = scene.numVertices;
+  expected.unitSize = unitSize;
+  expected.numUnits = (scene.numVertices + unitSize - 1) / unitSize;
+  expected.numIterations = settings.numBounces;
+  const uint64_t sizeBytes =
+      getSharedBakeSizeBytes(expected.numVertices, expected.numUnits);
+
+  bake.file = openSharedBakeFile(fileName);
+  if (bake.file == INVALID_HANDLE_VALUE) {
+    fatal("Failed to open shared bake file.");
+  }
+  LARGE_INTEGER fileSize{};
+  GetFileSizeEx(bake.file, &fileSize);
+  bool canResume = static_cast<uint64_t>(fileSize.QuadPart) == sizeBytes;
+  if (canResume) {
+    SharedBakeHeader existing;
+    DWORD bytesRead = 0;
+    canResume = ReadFile(bake.file, &existing, sizeof(existing), &bytesRead,
+                         NULL) &&
+                bytesRead == sizeof(existing) &&
+                existing.magic == expected.magic &&
+                existing.version == expected.version &&
+                existing.meshHash == expected.meshHash &&
+                existing.settingsHash == expected.settingsHash &&
+                existing.numUnits == expected.numUnits &&
+                existing.unitSize == expected.unitSize &&
+                existing.numIterations == expected.numIterations;
+  }
+
+  mapSharedBake(bake, sizeBytes);
+  if (canResume) {
+    locateSharedBakeArrays(bake);
+    // nobody is running yet, units claimed by a previous run are lost
+    const LONG iteration = bake.header->iteration;
+    uint32_t numDone = 0;
+    for (uint32_t unitIx = 0; unitIx < bake.header->numUnits; ++unitIx) {
+      if (bake.unitStates[unitIx] == getUnitDoneState(iteration)) {
+        ++numDone;
+      } else if (bake.unitStates[unitIx] > 0) {
+        bake.unitStates[unitIx] = kUnitNeverDone;
+      }
+    }
+    std::println("Resuming bake at iteration {}/{}, {}/{} units done",
+                 iteration + 1, bake.header->numIterations, numDone,
+                 bake.header->numUnits);
+  } else {
+    *bake.header = expected;
+    locateSharedBakeArrays(bake);
+    for (uint32_t unitIx = 0; unitIx < expected.numUnits; ++unitIx) {
+      bake.unitStates[unitIx] = kUnitNeverDone;
+    }
+    CopyMemory(bake.radiances[0], emission,
+               sizeof(HMM_Vec3) * scene.numVertices);
+  }
+  FlushViewOfFile(bake.view, 0);
+  delete[] emission;
+}
+
+// Starts a worker inside `job`, it is suspended until assigned so that it
+// never runs outside of the job.
+static bool spawnWorker(const char* assetPath, uint32_t numWorkerThreads,
+                        HANDLE job, PROCESS_INFORMATION& process) {
+  char exePath[MAX_PATH];
+  GetModuleFileNameA(NULL, exePath, MAX_PATH);
+  char cmdLine[3 * MAX_PATH];
+  snprintf(cmdLine, sizeof(cmdLine), "\"%s\" --bake-worker \"%s\" %u",
+           exePath, assetPath, numWorkerThreads);
+  STARTUPINFOA startupInfo{};
+  startupInfo.cb = sizeof(startupInfo);
+  if (!CreateProcessA(NULL, cmdLine, NULL, NULL, FALSE, CREATE_SUSPENDED,
+                      NULL, NULL, &startupInfo, &process)) {
+    return false;
+  }
+  if (!AssignProcessToJobObject(job, process.hProcess)) {
+    TerminateProcess(process.hProcess, 1);
+    CloseHandle(process.hProcess);
+    CloseHandle(process.hThread);
+    return false;
+  }
+  ResumeThread(process.hThread);
+  return true;
+}
+
+void runBakeCoordinator(const char* assetPath, const GatherSettings& settings,
+                        uint32_t numWorkers, uint32_t unitSize) {
+  Scene scene = readSceneAsset(assetPath);
+  char bakePath[MAX_PATH];
+  snprintf(bakePath, MAX_PATH, "%s.bake", assetPath);
+  SharedBake bake;
+  openOrCreateSharedBake(bakePath, scene, settings, unitSize, bake);
+  SharedBakeHeader& header = *bake.header;
+
+  // the cores are shared by the workers, each runs a GL thread and reduces
+  // on the rest of its share
+  const uint32_t numCores = std::thread::hardware_concurrency();
+  const uint32_t numWorkerThreads =
+      settings.numWorkerThreads > 0
+          ? settings.numWorkerThreads
+          : HMM_MAX(numCores / numWorkers, 2u) - 1;
+  // Workers are killed when the coordinator exits for any reason. Without it
+  // nobody advances the iteration, and a restarted coordinator hands out
+  // the units they claimed again.
+  HANDLE job = CreateJobObjectA(NULL, NULL);
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION jobLimits{};
+  jobLimits.BasicLimitInformation.LimitFlags =
+      JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+  if (!job ||
+      !SetInformationJobObject(job, JobObjectExtendedLimitInformation,
+                               &jobLimits, sizeof(jobLimits))) {
+    fatal("Failed to create bake worker job.");
+  }
+  PROCESS_INFORMATION* workers = new PROCESS_INFORMATION[numWorkers];
+  HANDLE* workerHandles = new HANDLE[numWorkers];
+  for (uint32_t w = 0; w < numWorkers; ++w) {
+    if (!spawnWorker(assetPath, numWorkerThreads, job, workers[w])) {
+      fatal("Failed to start bake worker.");
+    }
+    workerHandles[w] = workers[w].hProcess;
+  }
+  // a worker that keeps crashing should not be restarted forever
+  uint32_t numRespawnsLeft = 4 * numWorkers;
+  uint32_t numAlive = numWorkers;
+
+  while (numAlive > 0) {
+    const DWORD waitResult =
+        WaitForMultipleObjects(numAlive, workerHandles, FALSE, 100);
+    if (waitResult < WAIT_OBJECT_0 + numAlive) {
+      const uint32_t w = waitResult - WAIT_OBJECT_0;
+      DWORD exitCode = 0;
+      GetExitCodeProcess(workers[w].hProcess, &exitCode);
+      const LONG pid = static_cast<LONG>(workers[w].dwProcessId);
+      for (uint32_t unitIx = 0; unitIx < header.numUnits; ++unitIx) {
+        InterlockedCompareExchange(&bake.unitStates[unitIx], kUnitNeverDone,
+                                   pid);
+      }
+      CloseHandle(workers[w].hProcess);
+      CloseHandle(workers[w].hThread);
+      if (header.iteration < static_cast<LONG>(header.numIterations)) {
+        std::println("Worker {} exited with {}, its units are reassigned", pid,
+                     exitCode);
+        if (numRespawnsLeft == 0) {
+          fatal("Bake workers keep failing, giving up.");
+        }
+        --numRespawnsLeft;
+        if (!spawnWorker(assetPath, numWorkerThreads, job, workers[w])) {
+          fatal("Failed to restart bake worker.");
+        }
+        workerHandles[w] = workers[w].hProcess;
+      } else {
+        --numAlive;
+        workers[w] = workers[numAlive];
+        workerHandles[w] = workerHandles[numAlive];
+      }
+    }
+
+    if (header.iteration >= static_cast<LONG>(header.numIterations)) {
+      continue;
+    }
+    const LONG iteration = header.iteration;
+    bool isIterationDone = true;
+    for (uint32_t unitIx = 0; unitIx < header.numUnits && isIterationDone;
+         ++unitIx) {
+      isIterationDone =
+          bake.unitStates[unitIx] == getUnitDoneState(iteration);
+    }
+    if (isIterationDone) {
+      InterlockedIncrement(&header.iteration);
+      FlushViewOfFile(bake.view, sizeof(SharedBakeHeader));
+      std::println("Iteration {}/{} done", iteration + 1,
+                   header.numIterations);
+    }
+  }
+
+  CloseHandle(job);
+
+  char cachePath[MAX_PATH];
+  snprintf(cachePath, MAX_PATH, "%s.cache", assetPath);
+  const bool isWritten =
+      writeBakeCache(cachePath, header.meshHash, header.settingsHash,
+                     header.numVertices,
+                     bake.radiances[header.numIterations % 2]);
+  closeSharedBake(bake);
+  if (!isWritten) {
+    fatal("Failed to write radiance cache.");
+  }
+  DeleteFileA(bakePath);
+  std::println("Wrote {}", cachePath);
+  delete[] workerHandles;
+  delete[] workers;
+}
+
+void runBakeWorker(const Gatherer& g, const char* assetPath) {
+  Scene scene = readSceneAsset(assetPath);
+  scene.colorFormat = g.settings.radianceFormat;
+  createSceneBuffers(scene);
+  HMM_Vec3* emission = new HMM_Vec3[scene.numVertices];
+  copySceneEmission(scene, emission);
+  HMM_Vec3* gathered = new HMM_Vec3[scene.numVertices];
+
+  char bakePath[MAX_PATH];
+  snprintf(bakePath, MAX_PATH, "%s.bake", assetPath);
+  SharedBake bake;
+  bake.file = openSharedBakeFile(bakePath);
+  if (bake.file == INVALID_HANDLE_VALUE) {
+    fatal("Failed to open shared bake file.");
+  }
+  mapSharedBake(bake, 0);
+  locateSharedBakeArrays(bake);
+  SharedBakeHeader& header = *bake.header;
+  if (header.magic != kSharedBakeMagic ||
+      header.numVertices != scene.numVertices) {
+    fatal("Shared bake file does not belong to this asset.");
+  }
+
+  const LONG pid = static_cast<LONG>(GetCurrentProcessId());
+  // iteration whose input radiances are in the scene's color buffer
+  LONG uploadedIteration = -1;
+  uint32_t nextUnitIx = 0;
+  while (header.iteration < static_cast<LONG>(header.numIterations)) {
+    const LONG iteration = header.iteration;
+    uint32_t unitIx = UINT32_MAX;
+    LONG claimedState = 0;
+    for (uint32_t i = 0; i < header.numUnits; ++i) {
+      const uint32_t candidate = (nextUnitIx + i) % header.numUnits;
+      const LONG state = bake.unitStates[candidate];
+      if (isUnitPending(state, iteration) &&
+          InterlockedCompareExchange(&bake.unitStates[candidate], pid,
+                                     state) == state) {
+        unitIx = candidate;
+        claimedState = state;
+        break;
+      }
+    }
+    if (unitIx == UINT32_MAX) {
+      // everything is claimed, wait for the other workers to finish
+      Sleep(1);
+      continue;
+    }
+    // The iteration may have advanced since it was read, then the unit was
+    // pending in a later iteration and is given back. Once the claim is seen
+    // with the iteration unchanged the iteration cannot advance before the
+    // unit is done.
+    if (header.iteration != iteration) {
+      InterlockedCompareExchange(&bake.unitStates[unitIx], claimedState, pid);
+      continue;
+    }
+    nextUnitIx = unitIx + 1;
+
+    const HMM_Vec3* input = bake.radiances[iteration % 2];
+    HMM_Vec3* output = bake.radiances[(iteration + 1) % 2];
+    if (uploadedIteration != iteration) {
+      uploadSceneColors(scene, input);
+      uploadedIteration = iteration;
+    }
+    const uint32_t first = unitIx * header.unitSize;
+    const uint32_t count =
+        HMM_MIN(header.unitSize, header.numVertices - first);
+    gatherSceneVertices(g, scene, first, count, gathered);
+    for (uint32_t v = first; v < first + count; ++v) {
+      output[v] = emission[v] + gathered[v];
+    }
+    // checkpoint: radiances reach the disk before the unit is marked done,
+    // FlushViewOfFile only starts writing the pages back
+    FlushViewOfFile(output + first, sizeof(HMM_Vec3) * count);
+    if (!FlushFileBuffers(bake.file)) {
+      fatal("Failed to flush shared bake file.");
+    }
+    InterlockedExchange(&bake.unitStates[unitIx], getUnitDoneState(iteration));
+    FlushViewOfFile(const_cast<LONG*>(&bake.unitStates[unitIx]),
+                    sizeof(LONG));
+  }
+
+  closeSharedBake(bake);
+  delete[] gathered;
+  delete[] emission;
+}
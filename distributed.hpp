@@ -0,0 +1,57 @@
+#pragma once
+
+#include "gather.hpp"
+
+// Multi-process bake on a single machine. The coordinator splits the scene
+// vertices into work units and spawns worker processes that claim units,
+// gather them and write radiances into a memory-mapped file shared by all
+// processes (<asset>.bake). A finished unit is flushed to disk before it is
+// marked done, so killing any process loses at most the units in flight:
+// units of dead workers are handed out again, and restarting the coordinator
+// resumes a partially finished bake from the file. Workers run in a job that
+// kills them when the coordinator exits. When all Jacobi iterations
+// are done the result becomes the radiance cache of the asset.
+constexpr uint32_t kSharedBakeMagic = 0x42494752;  // "RGIB"
+constexpr uint32_t kSharedBakeVersion = 1;
+
+struct SharedBakeHeader {
+  uint32_t magic{kSharedBakeMagic};
+  uint32_t version{kSharedBakeVersion};
+  uint64_t meshHash{};
+  uint64_t settingsHash{};
+  uint32_t numVertices{};
+  uint32_t numUnits{};
+  uint32_t unitSize{};
+  uint32_t numIterations{};
+  // current Jacobi iteration, numIterations once the bake is finished
+  volatile LONG iteration{};
+  uint32_t padding{};
+};
+
+// Work unit states: 0 when never done, the process id of the claiming worker
+// while being gathered and -(k + 1) once done in iteration k. A unit is
+// pending in iteration k unless it is claimed or done in k, so advancing the
+// iteration hands out all units again without touching them.
+constexpr LONG kUnitNeverDone = 0;
+
+// The mapped file: header, numUnits unit states, then two radiance arrays.
+// Iteration k reads radiances[k % 2] and writes radiances[(k + 1) % 2].
+struct SharedBake {
+  HANDLE file{INVALID_HANDLE_VALUE};
+  HANDLE mapping{};
+  void* view{};
+  SharedBakeHeader* header{};
+  volatile LONG* unitStates{};
+  HMM_Vec3* radiances[2]{};
+};
+
+// Bakes assetPath with numWorkers worker processes of this executable and
+// returns once the radiance cache is written. Workers get
+// settings.numWorkerThreads threads each, or an equal share of the cores
+// when 0.
+void runBakeCoordinator(const char* assetPath, const GatherSettings& settings,
+                        uint32_t numWorkers, uint32_t unitSize);
+// Claims and gathers units until the bake is finished. Needs a GL context with
+// the gather program bound, `g` should use the numWorkerThreads passed on the
+// worker command line.
+void runBakeWorker(const Gatherer& g, const char* assetPath);
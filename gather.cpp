@@ -0,0 +1,542 @@
+#include "gather.hpp"
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <print>
+
+Gatherer createGatherer(const GatherSettings& settings, GLuint prog) {
+  Gatherer g;
+  g.settings = settings;
+  g.texWidth = settings.viewportSide * settings.numViewports;
+  g.texHeight = settings.viewportSide;
+
+  GLint colorInternalFormat = GL_RGB32F;
+  g.pixelType = GL_FLOAT;
+  g.pixelSizeBytes = 3 * sizeof(float);
+  if (settings.colorFormat == GatherColorFormat::RGBA16F) {
+    colorInternalFormat = GL_RGBA16F;
+    // alpha is not read back
+    g.pixelType = GL_HALF_FLOAT;
+    g.pixelSizeBytes = 3 * sizeof(uint16_t);
+  } else if (settings.colorFormat == GatherColorFormat::R11G11B10F) {
+    colorInternalFormat = GL_R11F_G11F_B10F;
+    g.pixelType = GL_UNSIGNED_INT_10F_11F_11F_REV;
+    g.pixelSizeBytes = sizeof(uint32_t);
+  }
+  g.rowSizeBytes = (g.texWidth * g.pixelSizeBytes + 3) & ~3u;
+  // moving texture data out of stack because surpassed memory limit :-O
+  g.pixels = new uint8_t[g.rowSizeBytes * g.texHeight];
+  const uint32_t numSlots = HMM_MAX(settings.numReadbackSlots, 1u);
+  g.settings.numReadbackSlots = numSlots;
+  g.readbackBuffers = new GLuint[numSlots];
+  glCreateBuffers(numSlots, g.readbackBuffers);
+  for (uint32_t slotIx = 0; slotIx < numSlots; ++slotIx) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, g.readbackBuffers[slotIx]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, g.rowSizeBytes * g.texHeight, nullptr,
+                 GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  glGenTextures(1, &g.colorTex);
+  glBindTexture(GL_TEXTURE_2D, g.colorTex);
+  glTexImage2D(GL_TEXTURE_2D, 0, colorInternalFormat, g.texWidth, g.texHeight,
+               0, GL_RGB, GL_FLOAT, nullptr);
+
+  const GLint depthInternalFormat =
+      settings.depthFormat == GatherDepthFormat::Depth16   ? GL_DEPTH_COMPONENT16
+      : settings.depthFormat == GatherDepthFormat::Depth24 ? GL_DEPTH_COMPONENT24
+                                                           : GL_DEPTH_COMPONENT32F;
+  glGenTextures(1, &g.depthTex);
+  glBindTexture(GL_TEXTURE_2D, g.depthTex);
+  glTexImage2D(GL_TEXTURE_2D, 0, depthInternalFormat, g.texWidth, g.texHeight,
+               0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+
+  glGenFramebuffers(1, &g.fb);
+  glBindFramebuffer(GL_FRAMEBUFFER, g.fb);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         g.colorTex, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                         g.depthTex, 0);
+  const GLenum fbStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (fbStatus != GL_FRAMEBUFFER_COMPLETE) {
+    if (fbStatus == GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT)
+      fatal("Framebuffer not complete due to incomplete attachment.");
+    if (fbStatus == GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT)
+      fatal("Framebuffer not complete due to missing attachment.");
+    fatal("Failed to complete offscreen framebuffer");
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  g.uWorldFromObjectLoc = glGetUniformLocation(prog, "uWorldFromObject");
+  g.uViewFromWorldLoc = glGetUniformLocation(prog, "uViewFromWorld");
+  g.uProjectionFromViewLoc = glGetUniformLocation(prog, "uProjectionFromView");
+
+  const uint32_t numCores = std::thread::hardware_concurrency();
+  g.scheduler = createTaskScheduler(settings.numWorkerThreads > 0
+                                        ? settings.numWorkerThreads
+                                        : HMM_MAX(numCores, 2u) - 1);
+  g.stats = new GatherStats;
+  return g;
+}
+
+void destroyGatherer(Gatherer& g) {
+  destroyTaskScheduler(g.scheduler);
+  glDeleteFramebuffers(1, &g.fb);
+  glDeleteTextures(1, &g.colorTex);
+  glDeleteTextures(1, &g.depthTex);
+  delete[] g.pixels;
+  glDeleteBuffers(g.settings.numReadbackSlots, g.readbackBuffers);
+  delete[] g.readbackBuffers;
+  delete g.stats;
+  g = {};
+}
+
+void printGatherStats(const Gatherer& g) {
+  const GatherStats& stats = *g.stats;
+  const double wallMs = HMM_MAX(stats.wallMs, 1e-9);
+  const double reduceMs = stats.reduceNs * 1e-6;
+  std::println("Gathered {} points in {} batches, {:.1f} ms, {:.0f} points/s",
+               stats.numPoints, stats.numBatches, stats.wallMs,
+               stats.numPoints / wallMs * 1000.0);
+  std::println("  GL thread: draw {:.0f}%, setup wait {:.0f}%, readback wait "
+               "{:.0f}%, slot wait {:.0f}%",
+               100.0 * stats.drawMs / wallMs, 100.0 * stats.setupWaitMs / wallMs,
+               100.0 * stats.readbackWaitMs / wallMs,
+               100.0 * stats.slotWaitMs / wallMs);
+  std::println("  reduction: {:.1f} ms, {:.0f}% of {} threads, at most {} of "
+               "{} slots in flight",
+               reduceMs, 100.0 * reduceMs / (wallMs * g.scheduler->numThreads),
+               g.scheduler->numThreads, stats.maxBatchesInFlight,
+               g.settings.numReadbackSlots);
+}
+
+// viewports averaged per reduction task
+constexpr uint32_t kReduceGrainSize = 8;
+// gather points culled per setup task
+constexpr uint32_t kSetupGrainSize = 16;
+
+static void drawBatchViews(const Gatherer& g, uint32_t numPoints,
+                           const HMM_Vec3* positions, const HMM_Vec3* normals,
+                           DrawGatherViewFn drawView,
+                           const void* drawContext) {
+  constexpr Vec3 kUp{0, 0, 1};
+  const GLsizei viewportSide = g.settings.viewportSide;
+
+  const Mat4 projectionFromView =
+      perspective(g.settings.highFOV, 1.0f, g.settings.nearPlane,
+                  g.settings.farPlane);
+  glUniformMatrix4fv(g.uProjectionFromViewLoc, 1, GL_FALSE,
+                     &projectionFromView.xx);
+
+  // Loop over every vertex, render the scene from vertex position into normal
+  // direction into a small texture take average pixel of the texture and
+  // store it as the incoming radiance for that vertex
+  glBindFramebuffer(GL_FRAMEBUFFER, g.fb);
+  // clears only affect the current viewport
+  glEnable(GL_SCISSOR_TEST);
+  glEnable(GL_DEPTH_TEST);
+  glClearColor(0.f, 0.f, 0.f, 1.0f);
+  // view matrices are built kSimdWidth points at a time
+  Vec3x8 lanePositions;
+  Vec3x8 laneNormals;
+  Mat4 viewFromWorlds[kSimdWidth];
+  for (uint32_t v = 0; v < numPoints; ++v) {
+    const uint32_t lane = v % kSimdWidth;
+    if (lane == 0) {
+      for (uint32_t i = 0; i < kSimdWidth; ++i) {
+        // lanes past the last point repeat it
+        const uint32_t pointIx = HMM_MIN(v + i, numPoints - 1);
+        lanePositions.x[i] = positions[pointIx].X;
+        lanePositions.y[i] = positions[pointIx].Y;
+        lanePositions.z[i] = positions[pointIx].Z;
+        laneNormals.x[i] = normals[pointIx].X;
+        laneNormals.y[i] = normals[pointIx].Y;
+        laneNormals.z[i] = normals[pointIx].Z;
+      }
+      lookAtBatch(lanePositions, laneNormals, kUp, viewFromWorlds);
+    }
+    glViewport(v * viewportSide, 0, viewportSide, viewportSide);
+    glScissor(v * viewportSide, 0, viewportSide, viewportSide);
+    glUniformMatrix4fv(g.uViewFromWorldLoc, 1, GL_FALSE,
+                       &viewFromWorlds[lane].xx);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    drawView(drawContext, v, positions[v], normals[v]);
+  }
+}
+
+struct ReduceContext {
+  const Gatherer* g;
+  // read back atlas, laid out like g->pixels
+  const uint8_t* pixels;
+  HMM_Vec3* gathered;
+  // when set, radiances = emission + gathered
+  const HMM_Vec3* emission;
+  HMM_Vec3* radiances;
+};
+
+// Sum of numPixels read back pixels of a row, starting at firstPixel.
+static HMM_Vec3 sumPixels(const Gatherer& g, const uint8_t* row,
+                          uint32_t firstPixel, uint32_t numPixels) {
+  HMM_Vec3 sum = HMM_V3(0, 0, 0);
+  switch (g.settings.colorFormat) {
+    case GatherColorFormat::RGB32F: {
+      const HMM_Vec3* pixels = reinterpret_cast<const HMM_Vec3*>(row);
+      for (uint32_t j = firstPixel; j < firstPixel + numPixels; ++j) {
+        sum += pixels[j];
+      }
+      break;
+    }
+    case GatherColorFormat::RGBA16F: {
+      const uint16_t* halves = reinterpret_cast<const uint16_t*>(row);
+      for (uint32_t j = firstPixel; j < firstPixel + numPixels; ++j) {
+        sum += HMM_V3(halfToFloat(halves[3 * j]), halfToFloat(halves[3 * j + 1]),
+                      halfToFloat(halves[3 * j + 2]));
+      }
+      break;
+    }
+    case GatherColorFormat::R11G11B10F: {
+      const uint32_t* packed = reinterpret_cast<const uint32_t*>(row);
+      for (uint32_t j = firstPixel; j < firstPixel + numPixels; ++j) {
+        sum += unpackR11G11B10F(packed[j]);
+      }
+      break;
+    }
+  }
+  return sum;
+}
+
+// Averages the read back viewports [first, first + count).
+static void reduceViewports(const void* context, uint32_t first,
+                            uint32_t count) {
+  const auto start = std::chrono::steady_clock::now();
+  const ReduceContext& ctx = *static_cast<const ReduceContext*>(context);
+  const Gatherer& g = *ctx.g;
+  const GLsizei viewportSide = g.settings.viewportSide;
+  const GLsizei viewportArea = viewportSide * viewportSide;
+  for (uint32_t v = first; v < first + count; ++v) {
+    HMM_Vec3 totalRadiance = HMM_V3(0, 0, 0);
+    // const float viewportCenter = viewportSide * 0.5;
+    // non-physical weight to emphasize central pixels more than
+    // peripheral pixels
+    // const float weight = HMM_CosF((i - viewportCenter) /
+    //                              viewportCenter * HMM_PI * 0.5f) *
+    //                     HMM_CosF((j - viewportCenter) /
+    //                              viewportCenter * HMM_PI * 0.5f) *
+    //                     2.f;
+    for (uint32_t i = 0; i < viewportSide; ++i) {
+      const uint8_t* row = ctx.pixels + i * g.rowSizeBytes;
+      totalRadiance += sumPixels(g, row, v * viewportSide, viewportSide);
+    }
+    ctx.gathered[v] = totalRadiance / viewportArea;
+    if (ctx.emission) {
+      ctx.radiances[v] = ctx.emission[v] + ctx.gathered[v];
+    }
+  }
+  g.stats->reduceNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+}
+
+void gatherBatch(const Gatherer& g, uint32_t numPoints,
+                 const HMM_Vec3* positions, const HMM_Vec3* normals,
+                 DrawGatherViewFn drawView, const void* drawContext,
+                 HMM_Vec3* gathered) {
+  drawBatchViews(g, numPoints, positions, normals, drawView, drawContext);
+  glReadPixels(0, 0, g.texWidth, g.texHeight, GL_RGB, g.pixelType, g.pixels);
+  const ReduceContext ctx{&g, g.pixels, gathered, nullptr, nullptr};
+  parallelFor(*g.scheduler, reduceViewports, &ctx, 0, numPoints,
+              kReduceGrainSize);
+}
+
+// Gather points of a batch of scene vertices and the instances each of them
+// sees. Tasks set up the next batch while the current one is drawn.
+struct SceneGatherBatch {
+  const Gatherer* g;
+  const Scene* scene;
+  // numInstances per scheduler thread, for collectHemisphereInstances
+  uint32_t* threadInstanceIxs;
+  uint32_t numWordsPerPoint;
+  uint32_t firstVertIx;
+  uint32_t numPoints;
+  HMM_Vec3* positions;
+  HMM_Vec3* normals;
+  // numWordsPerPoint words per point, bit i is set if instance i is visible
+  uint64_t* visibleInstanceBits;
+  TaskGroup setup;
+};
+
+// Instance that scene vertex sceneVertIx belongs to, instances are ordered by
+// their first vertex.
+static uint32_t findVertexInstance(const Scene& scene, uint32_t sceneVertIx) {
+  uint32_t lo = 0;
+  uint32_t hi = scene.numInstances;
+  while (hi - lo > 1) {
+    const uint32_t mid = (lo + hi) / 2;
+    if (scene.instances[mid].firstVertex <= sceneVertIx) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void setupGatherPoints(const void* context, uint32_t first,
+                              uint32_t count) {
+  const SceneGatherBatch& b = *static_cast<const SceneGatherBatch*>(context);
+  const Scene& scene = *b.scene;
+  uint32_t* instanceIxs =
+      b.threadInstanceIxs + getTaskThreadIx() * scene.numInstances;
+  uint32_t instIx = findVertexInstance(scene, b.firstVertIx + first);
+  uint32_t v = first;
+  while (v < first + count) {
+    const uint32_t sceneVertIx = b.firstVertIx + v;
+    while (sceneVertIx >= scene.instances[instIx].firstVertex +
+                              scene.meshes[scene.instances[instIx].meshIx]
+                                  .numVertices) {
+      ++instIx;
+    }
+    // up to kSimdWidth vertices of the same instance at once
+    const Instance& inst = scene.instances[instIx];
+    const Mesh& mesh = scene.meshes[inst.meshIx];
+    const uint32_t vertIx = sceneVertIx - inst.firstVertex;
+    const uint32_t numLanes = HMM_MIN(
+        kSimdWidth, HMM_MIN(first + count - v, mesh.numVertices - vertIx));
+    const Mat4 worldFromObject = toMat4(inst.worldFromObject);
+    Vec3x8 positions;
+    Vec3x8 normals;
+    transformPointsBatch(worldFromObject, mesh.positionsSoa, vertIx,
+                         positions);
+    transformNormalsBatch(worldFromObject, mesh.normalsSoa, vertIx, normals);
+
+    for (uint32_t lane = 0; lane < numLanes; ++lane, ++v) {
+      b.positions[v] =
+          HMM_V3(positions.x[lane], positions.y[lane], positions.z[lane]);
+      b.normals[v] = HMM_V3(normals.x[lane], normals.y[lane], normals.z[lane]);
+
+      uint64_t* bits = b.visibleInstanceBits + v * b.numWordsPerPoint;
+      memset(bits, 0, b.numWordsPerPoint * sizeof(uint64_t));
+      const uint32_t numVisible = collectHemisphereInstances(
+          scene, b.positions[v], b.normals[v], b.g->settings.farPlane,
+          instanceIxs);
+      for (uint32_t i = 0; i < numVisible; ++i) {
+        bits[instanceIxs[i] / 64] |= uint64_t{1} << (instanceIxs[i] % 64);
+      }
+    }
+  }
+}
+
+static void drawSceneGatherView(const void* context, uint32_t pointIx,
+                                HMM_Vec3 position, HMM_Vec3 normal) {
+  const SceneGatherBatch& b = *static_cast<const SceneGatherBatch*>(context);
+  const uint64_t* bits = b.visibleInstanceBits + pointIx * b.numWordsPerPoint;
+  for (uint32_t w = 0; w < b.numWordsPerPoint; ++w) {
+    for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+      drawInstance(*b.scene, w * 64 + std::countr_zero(word),
+                   b.g->uWorldFromObjectLoc);
+    }
+  }
+}
+
+static void submitBatchSetup(const Gatherer& g, SceneGatherBatch& b,
+                             uint32_t firstVertIx, uint32_t numPoints) {
+  b.firstVertIx = firstVertIx;
+  b.numPoints = numPoints;
+  submitTasks(*g.scheduler, b.setup, setupGatherPoints, &b, 0, numPoints,
+              kSetupGrainSize);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// A read back batch. The copy into `buffer` is in flight while `fence` is set,
+// the mapped pixels are reduced while reduceCtx.pixels is set.
+struct ReadbackSlot {
+  GLuint buffer;
+  GLsync fence;
+  uint32_t numPoints;
+  ReduceContext reduceCtx;
+  TaskGroup reduction;
+};
+
+// Maps the pixels of a finished readback and starts reducing them. Without
+// `wait` it returns false if the GPU is not done with the copy yet.
+static bool startReduction(const Gatherer& g, ReadbackSlot& slot, bool wait) {
+  const auto start = std::chrono::steady_clock::now();
+  for (;;) {
+    const GLenum status = glClientWaitSync(
+        slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+      break;
+    if (status == GL_WAIT_FAILED) fatal("Failed to wait for gather readback.");
+    if (!wait) return false;
+  }
+  if (wait) {
+    g.stats->readbackWaitMs += millisecondsSince(start);
+  }
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  slot.reduceCtx.pixels = static_cast<const uint8_t*>(
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, g.rowSizeBytes * g.texHeight,
+                       GL_MAP_READ_BIT));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (!slot.reduceCtx.pixels) fatal("Failed to map gather readback.");
+  submitTasks(*g.scheduler, slot.reduction, reduceViewports, &slot.reduceCtx,
+              0, slot.numPoints, kReduceGrainSize);
+  return true;
+}
+
+// Waits for the reduction of a slot and hands its buffer back to GL.
+static void finishReduction(const Gatherer& g, ReadbackSlot& slot) {
+  waitForTasks(*g.scheduler, slot.reduction);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  const GLboolean isIntact = glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (!isIntact) fatal("Gather readback was lost while mapped.");
+  slot.reduceCtx.pixels = nullptr;
+}
+
+// Gathers scene vertices [firstVertIx, firstVertIx + numVerts) in batches.
+// Three stages overlap: tasks set up the next batch while the GL thread draws
+// the current one, and after a batch is drawn its atlas is copied into one of
+// numReadbackSlots pixel pack buffers without waiting for the GPU. Finished
+// copies are mapped and reduced by tasks in batch order. The GL thread only
+// blocks when all slots are taken, so throughput approaches that of the slower
+// of drawing and reducing. With `emission` the reduction also writes
+// radiances = emission + gathered.
+static void gatherSceneRange(const Gatherer& g, const Scene& scene,
+                             uint32_t firstVertIx, uint32_t numVerts,
+                             HMM_Vec3* gathered, const HMM_Vec3* emission,
+                             HMM_Vec3* radiances) {
+  const auto rangeStart = std::chrono::steady_clock::now();
+  GatherStats& stats = *g.stats;
+  const uint32_t numViewports = g.settings.numViewports;
+  const uint32_t numWordsPerPoint = (scene.numInstances + 63) / 64;
+  uint32_t* threadInstanceIxs =
+      new uint32_t[g.scheduler->numThreads * scene.numInstances];
+  SceneGatherBatch batches[2];
+  for (SceneGatherBatch& b : batches) {
+    b.g = &g;
+    b.scene = &scene;
+    b.threadInstanceIxs = threadInstanceIxs;
+    b.numWordsPerPoint = numWordsPerPoint;
+    b.positions = new HMM_Vec3[numViewports];
+    b.normals = new HMM_Vec3[numViewports];
+    b.visibleInstanceBits = new uint64_t[numViewports * numWordsPerPoint];
+  }
+  const uint32_t numSlots = g.settings.numReadbackSlots;
+  ReadbackSlot* slots = new ReadbackSlot[numSlots]{};
+  for (uint32_t slotIx = 0; slotIx < numSlots; ++slotIx) {
+    slots[slotIx].buffer = g.readbackBuffers[slotIx];
+  }
+
+  const uint32_t numBatches = (numVerts + numViewports - 1) / numViewports;
+  if (numBatches > 0) {
+    submitBatchSetup(g, batches[0], firstVertIx,
+                     HMM_MIN(numViewports, numVerts));
+  }
+  // Batches [firstUnreduced, batchIx) are being copied, batches
+  // [firstUnfinished, firstUnreduced) are being reduced. Batch i uses slot
+  // i % numSlots.
+  uint32_t firstUnreduced = 0;
+  uint32_t firstUnfinished = 0;
+  for (uint32_t batchIx = 0; batchIx < numBatches; ++batchIx) {
+    SceneGatherBatch& b = batches[batchIx % 2];
+    if (batchIx + 1 < numBatches) {
+      const uint32_t next = (batchIx + 1) * numViewports;
+      submitBatchSetup(g, batches[(batchIx + 1) % 2], firstVertIx + next,
+                       HMM_MIN(numViewports, numVerts - next));
+    }
+    const auto setupStart = std::chrono::steady_clock::now();
+    waitForTasks(*g.scheduler, b.setup);
+    stats.setupWaitMs += millisecondsSince(setupStart);
+
+    const auto drawStart = std::chrono::steady_clock::now();
+    drawBatchViews(g, b.numPoints, b.positions, b.normals,
+                   drawSceneGatherView, &b);
+    stats.drawMs += millisecondsSince(drawStart);
+
+    // backpressure: the slot of this batch still holds the batch numSlots
+    // earlier
+    if (batchIx - firstUnfinished == numSlots) {
+      while (firstUnreduced <= firstUnfinished) {
+        startReduction(g, slots[firstUnreduced++ % numSlots], true);
+      }
+      const auto slotStart = std::chrono::steady_clock::now();
+      finishReduction(g, slots[firstUnfinished++ % numSlots]);
+      stats.slotWaitMs += millisecondsSince(slotStart);
+    }
+
+    const auto readbackStart = std::chrono::steady_clock::now();
+    ReadbackSlot& slot = slots[batchIx % numSlots];
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glReadPixels(0, 0, g.texWidth, g.texHeight, GL_RGB, g.pixelType, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.numPoints = b.numPoints;
+    slot.reduceCtx.g = &g;
+    slot.reduceCtx.pixels = nullptr;
+    slot.reduceCtx.gathered = gathered + b.firstVertIx;
+    slot.reduceCtx.emission = emission ? emission + b.firstVertIx : nullptr;
+    slot.reduceCtx.radiances = radiances ? radiances + b.firstVertIx : nullptr;
+    stats.drawMs += millisecondsSince(readbackStart);
+    stats.maxBatchesInFlight =
+        HMM_MAX(stats.maxBatchesInFlight, batchIx + 1 - firstUnfinished);
+
+    // reduce the copies that are done and free the slots of finished
+    // reductions, without waiting for either
+    while (firstUnreduced <= batchIx &&
+           startReduction(g, slots[firstUnreduced % numSlots], false)) {
+      ++firstUnreduced;
+    }
+    while (firstUnfinished < firstUnreduced &&
+           slots[firstUnfinished % numSlots].reduction.numPending == 0) {
+      finishReduction(g, slots[firstUnfinished++ % numSlots]);
+    }
+  }
+  while (firstUnreduced < numBatches) {
+    startReduction(g, slots[firstUnreduced++ % numSlots], true);
+  }
+  while (firstUnfinished < numBatches) {
+    finishReduction(g, slots[firstUnfinished++ % numSlots]);
+  }
+
+  delete[] slots;
+  for (SceneGatherBatch& b : batches) {
+    delete[] b.positions;
+    delete[] b.normals;
+    delete[] b.visibleInstanceBits;
+  }
+  delete[] threadInstanceIxs;
+  stats.numBatches += numBatches;
+  stats.numPoints += numVerts;
+  stats.wallMs += millisecondsSince(rangeStart);
+}
+
+void gatherRadiances(const Gatherer& g, const Scene& scene,
+                     const HMM_Vec3* radiances, HMM_Vec3* gathered) {
+  uploadSceneColors(scene, radiances);
+  gatherSceneRange(g, scene, 0, scene.numVertices, gathered, nullptr, nullptr);
+}
+
+void gatherSceneVertices(const Gatherer& g, const Scene& scene,
+                         uint32_t firstVertIx, uint32_t numVerts,
+                         HMM_Vec3* gathered) {
+  gatherSceneRange(g, scene, firstVertIx, numVerts, gathered, nullptr,
+                   nullptr);
+}
+
+void iterateRadiances(const Gatherer& g, const Scene& scene,
+                      const HMM_Vec3* emission, HMM_Vec3* radiances,
+                      HMM_Vec3* scratch) {
+  // radiances are only read by the upload, the reduction can overwrite them
+  uploadSceneColors(scene, radiances);
+  gatherSceneRange(g, scene, 0, scene.numVertices, scratch, emission,
+                   radiances);
+}
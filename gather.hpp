@@ -0,0 +1,122 @@
+#pragma once
+
+#include "opengl.hpp"
+#include "scene.hpp"
+#include "tasks.hpp"
+
+// Precision of the gather atlas. The read back pixels keep the atlas
+// precision, so smaller formats also move fewer bytes off the GPU.
+enum class GatherColorFormat : uint32_t { RGB32F, RGBA16F, R11G11B10F };
+enum class GatherDepthFormat : uint32_t { Depth32F, Depth24, Depth16 };
+
+// Parameters of the hemisphere gather. Every vertex renders the scene into a
+// viewportSide x viewportSide viewport of an offscreen atlas that holds
+// numViewports viewports side by side.
+struct GatherSettings {
+  GLsizei viewportSide = 32;
+  GLsizei numViewports = 256;
+  float highFOV = HMM_PI / 1.25;  //  HMM_PI - 0.05f; // ~179 deg
+  float nearPlane = 0.01f;
+  // geometry further away than this never contributes to a gather
+  float farPlane = 100.0f;
+  uint32_t numBounces = 3;
+  GatherColorFormat colorFormat = GatherColorFormat::RGB32F;
+  GatherDepthFormat depthFormat = GatherDepthFormat::Depth32F;
+  // format of the scene colors to gather, see Scene::colorFormat
+  RadianceFormat radianceFormat = RadianceFormat::Float32;
+  // CPU threads next to the GL thread, 0 for one per remaining core
+  uint32_t numWorkerThreads = 0;
+  // Batches that can be read back or reduced while the next one is drawn.
+  // Each has its own pixel pack buffer. 1 makes drawing wait for the
+  // reduction of the previous batch.
+  uint32_t numReadbackSlots = 3;
+};
+
+// Where the time of scene gathers went, accumulated over the gatherer's
+// lifetime.
+struct GatherStats {
+  uint32_t numBatches{};
+  uint32_t numPoints{};
+  // most batches read back or being reduced at the same time
+  uint32_t maxBatchesInFlight{};
+  double wallMs{};
+  // GL thread issuing draws and readbacks
+  double drawMs{};
+  // GL thread waiting for the setup tasks of the batch to draw
+  double setupWaitMs{};
+  // GL thread waiting for the GPU to finish a readback
+  double readbackWaitMs{};
+  // GL thread waiting for a reduction to free a slot, i.e. backpressure
+  double slotWaitMs{};
+  // summed over all threads
+  std::atomic<uint64_t> reduceNs{};
+};
+
+struct Gatherer {
+  GatherSettings settings;
+  GLsizei texWidth{};
+  GLsizei texHeight{};
+  GLuint colorTex{};
+  GLuint depthTex{};
+  GLuint fb{};
+  // read back atlas, GL_RGB pixels of pixelType
+  GLenum pixelType{};
+  uint32_t pixelSizeBytes{};
+  // rows are padded to GL_PACK_ALIGNMENT, i.e. 4 bytes
+  uint32_t rowSizeBytes{};
+  uint8_t* pixels{};
+  // numReadbackSlots pixel pack buffers of the same layout as pixels
+  GLuint* readbackBuffers{};
+  GLint uWorldFromObjectLoc{};
+  GLint uViewFromWorldLoc{};
+  GLint uProjectionFromViewLoc{};
+  // runs the CPU side of the gather: vertex setup, culling and reduction
+  TaskScheduler* scheduler{};
+  GatherStats* stats{};
+};
+
+Gatherer createGatherer(const GatherSettings& settings, GLuint prog);
+void destroyGatherer(Gatherer& g);
+
+// Prints the throughput and how busy the GL thread and the reduction were.
+void printGatherStats(const Gatherer& g);
+
+// Draws the geometry seen from gather point pointIx of the batch. Has to draw
+// with the gatherer's uWorldFromObject uniform, the view and projection are
+// already set.
+using DrawGatherViewFn = void (*)(const void* context, uint32_t pointIx,
+                                  HMM_Vec3 position, HMM_Vec3 normal);
+
+// Renders one view per gather point into the atlas, reads it back and writes
+// the average incoming radiance of each point into `gathered`. numPoints has
+// to be at most numViewports.
+void gatherBatch(const Gatherer& g, uint32_t numPoints,
+                 const HMM_Vec3* positions, const HMM_Vec3* normals,
+                 DrawGatherViewFn drawView, const void* drawContext,
+                 HMM_Vec3* gathered);
+
+// Uploads `radiances` as vertex colors, renders the hemisphere above every
+// instance vertex and writes the average incoming radiance into `gathered`.
+// Only instances overlapping the hemisphere are drawn. Expects the gather
+// program to be bound.
+void gatherRadiances(const Gatherer& g, const Scene& scene,
+                     const HMM_Vec3* radiances, HMM_Vec3* gathered);
+
+// Same as gatherRadiances for scene vertices [firstVertIx, firstVertIx +
+// numVerts) only, with radiances already uploaded via uploadSceneColors.
+// `gathered` is indexed by scene vertex.
+void gatherSceneVertices(const Gatherer& g, const Scene& scene,
+                         uint32_t firstVertIx, uint32_t numVerts,
+                         HMM_Vec3* gathered);
+
+// One Jacobi step of L = E + T * L, i.e.
+// radiances = emission + gather(radiances). `scratch` receives the gathered
+// radiance. The emission is added by the tasks that reduce each batch, so the
+// step needs no separate pass over the vertices.
+// Starting from radiances = emission, numBounces steps give the same result as
+// summing numBounces separate bounces. Starting from any other radiances L0
+// adds T^numBounces * L0 to the result, so bakes that are cached always start
+// from the emission.
+void iterateRadiances(const Gatherer& g, const Scene& scene,
+                      const HMM_Vec3* emission, HMM_Vec3* radiances,
+                      HMM_Vec3* scratch);
@@ -1,6 +1,15 @@
 // Original idea: https://iquilezles.org/articles/simplegi/
 
+#include "cache.hpp"
+#include "chunked.hpp"
+#include "distributed.hpp"
+#include "gather.hpp"
+#include "mesh.hpp"
 #include "opengl.hpp"
+#include "precision.hpp"
+#include "scene.hpp"
+#include "stream.hpp"
+#include "sweep.hpp"
 // #include <gl/GL.h>
 // #include "math.hpp"
 #include <vendor/HandmadeMath.h>
@@ -27,69 +36,50 @@ static inline float getTime() {
          static_cast<float>(freq.QuadPart);
 }
 
-struct Mesh {
-  unsigned int numVertices{};
-  unsigned int numIndices{};
-  HMM_Vec3* positions{};
-  HMM_Vec3* normals{};
-  HMM_Vec3* colors{};
-  unsigned int* indices{};
-  // ~Mesh() { delete[] positions; delete[] normals; delete[] colors; }
-};
-
-Mesh readMeshFromFile(const char* fileName) {
-  HANDLE hFile = CreateFileA(fileName, GENERIC_READ, 0, NULL, OPEN_EXISTING,
-                             FILE_ATTRIBUTE_NORMAL, NULL);
-  if (hFile == INVALID_HANDLE_VALUE) {
-    fatal("Failed to open file");
-  }
-
-  Mesh mesh;
-  DWORD bytesRead = 0;
-  if (!ReadFile(hFile, &mesh.numVertices, sizeof(unsigned int), &bytesRead,
-                nullptr) ||
-      bytesRead != sizeof(unsigned int)) {
-    fatal("Failed to read numVertices from file.");
-  };
-
-  if (!ReadFile(hFile, &mesh.numIndices, sizeof(unsigned int), &bytesRead,
-                nullptr) ||
-      bytesRead != sizeof(unsigned int)) {
-    fatal("Failed to read numIndices from file.");
+int main(int argc, char** argv) {
+  // raster-gi --chunk <in.mesh> <out.cmesh> [maxChunkTriangles] [memoryCapMiB]
+  // raster-gi --stream-bake <in.cmesh> [memoryCapMiB]
+  // raster-gi --bake <asset> [numWorkers] [unitSize]
+  // raster-gi --precision-report <asset>
+  // raster-gi --sweep <asset>
+  if (argc >= 4 && strcmp(argv[1], "--chunk") == 0) {
+    const uint32_t maxChunkTriangles =
+        argc > 4 ? strtoul(argv[4], nullptr, 10) : 65536;
+    const uint64_t memoryCapMiB =
+        argc > 5 ? strtoull(argv[5], nullptr, 10) : 1024;
+    writeChunkedMeshFromFile(argv[2], argv[3], maxChunkTriangles,
+                             memoryCapMiB << 20);
+    return 0;
   }
-
-  const DWORD attrSizeBytes = mesh.numVertices * sizeof(HMM_Vec3);
-  mesh.positions = new HMM_Vec3[mesh.numVertices];
-  mesh.normals = new HMM_Vec3[mesh.numVertices];
-  mesh.colors = new HMM_Vec3[mesh.numVertices];
-  for (HMM_Vec3* attr : {mesh.positions, mesh.normals, mesh.colors}) {
-    if (!ReadFile(hFile, attr, attrSizeBytes, &bytesRead, NULL) ||
-        bytesRead != attrSizeBytes) {
-      fatal("Failed to read position data.");
-    }
+  if (argc >= 3 && strcmp(argv[1], "--bake") == 0) {
+    // WaitForMultipleObjects can wait for at most 64 workers
+    const uint32_t numWorkers = HMM_MIN(
+        argc > 3 ? strtoul(argv[3], nullptr, 10) : 4, MAXIMUM_WAIT_OBJECTS);
+    const uint32_t unitSize =
+        argc > 4 ? strtoul(argv[4], nullptr, 10) : 4096;
+    runBakeCoordinator(argv[2], GatherSettings{}, HMM_MAX(numWorkers, 1u),
+                       HMM_MAX(unitSize, 1u));
+    return 0;
   }
+  const bool isStreamBake =
+      argc >= 3 && strcmp(argv[1], "--stream-bake") == 0;
+  const uint64_t memoryCapBytes =
+      (argc > 3 ? strtoull(argv[3], nullptr, 10) : 1024) << 20;
+  // spawned by --bake as --bake-worker <asset> <numWorkerThreads>
+  const bool isBakeWorker = argc >= 3 && strcmp(argv[1], "--bake-worker") == 0;
+  const bool isPrecisionReport =
+      argc >= 3 && strcmp(argv[1], "--precision-report") == 0;
+  const bool isSweep = argc >= 3 && strcmp(argv[1], "--sweep") == 0;
 
-  const DWORD indicesSizeBytes = mesh.numIndices * sizeof(unsigned int);
-  mesh.indices = new unsigned int[mesh.numIndices];
-  if (!ReadFile(hFile, mesh.indices, indicesSizeBytes, &bytesRead, NULL) ||
-      bytesRead != indicesSizeBytes) {
-    fatal("Failed to read position data.");
-  }
-
-  for (uint32_t vertIx = 0; vertIx < mesh.numVertices; ++vertIx) {
-    mesh.colors[vertIx] *=
-        4;  // temporarily increase intensity here, should be done in Blender
-  }
-
-  return mesh;
-}
-
-int main() {
   loadWglCreateContextAttribsARB();
   HDC dev;
   const uint32_t winWidth = 1920;
   const uint32_t winHeight = 1080;
-  createAndShowWindow("RasterGI", winWidth, winHeight, dev);
+  if (isStreamBake || isBakeWorker || isPrecisionReport || isSweep) {
+    createHiddenWindow(dev);
+  } else {
+    createAndShowWindow("RasterGI", winWidth, winHeight, dev);
+  }
   setPixelFormatFancy(dev);
   createAndMakeOpenGlContext(dev);
 
@@ -98,37 +88,6 @@ int main() {
 
   const HMM_Vec3 kUp = HMM_V3(0, 0, 1);
 
-  char path[MAX_PATH];
-  GetCurrentDirectoryA(MAX_PATH, path);
-  strcat_s(path, "\\assets\\");
-  strcat_s(path, "trees.mesh");
-  Mesh mesh = readMeshFromFile(path);
-  std::println("numVertices {}, numIndices {}", mesh.numVertices,
-               mesh.numIndices);
-  for (unsigned int vertIx = 0; vertIx < 3; vertIx++) {
-    const HMM_Vec3& pos = mesh.positions[vertIx];
-    const HMM_Vec3& norm = mesh.normals[vertIx];
-    const HMM_Vec3& col = mesh.colors[vertIx];
-  }
-
-  auto createVertexBuffer = [](GLuint& id, GLsizeiptr size, const void* data) {
-    glCreateBuffers(1, &id);
-    glBindBuffer(GL_ARRAY_BUFFER, id);
-    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
-  };
-  const GLsizeiptr bufferSizeBytes = mesh.numVertices * sizeof(HMM_Vec3);
-  GLuint vbPosition;
-  createVertexBuffer(vbPosition, bufferSizeBytes, mesh.positions);
-  GLuint vbNormal;
-  createVertexBuffer(vbNormal, bufferSizeBytes, mesh.normals);
-  GLuint vbColor;
-  createVertexBuffer(vbColor, bufferSizeBytes, mesh.colors);
-  GLuint ib;
-  glCreateBuffers(1, &ib);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.numIndices * sizeof(unsigned int),
-               mesh.indices, GL_STATIC_DRAW);
-
   const char* vertSrc = R"glsl(
 #version 460
 
@@ -154,7 +113,7 @@ void main() {
     gl_Position = MVP * vec4(aPosition, 1.0);
     
     vWorldPos = vec3(uWorldFromObject * vec4(aPosition, 1));
-    vNormal = aNormal;
+    vNormal = mat3(uWorldFromObject) * aNormal;
     vColor = aColor;
 }
 )glsl";
@@ -176,9 +135,6 @@ void main() {
   const GLuint prog = compileShader(vertSrc, fragSrc);
   glUseProgram(prog);
 
-  uint32_t vao;
-  glCreateVertexArrays(1, &vao);
-
   const GLint uTimeLoc = glGetUniformLocation(prog, "uTime");
 
   const GLint uWorldFromObjectLoc =
@@ -187,56 +143,93 @@ void main() {
   const GLint uProjectionFromViewLoc =
       glGetUniformLocation(prog, "uProjectionFromView");
 
-  const GLsizei viewportSide = 32;
-  const GLsizei viewportArea = viewportSide * viewportSide;
-  const GLsizei numViewports = 256;
-
-  const GLsizei texWidth = viewportSide * numViewports;
-  const GLsizei texHeight = viewportSide;
-  // moving texture data out of stack because surpassed memory limit :-O
-  HMM_Vec3* pixels = new HMM_Vec3[texWidth * texHeight];
-
-  GLuint colorTexOffScreen{};
-  glGenTextures(1, &colorTexOffScreen);
-  glBindTexture(GL_TEXTURE_2D, colorTexOffScreen);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, texWidth, texHeight, 0, GL_RGB,
-               GL_FLOAT, nullptr);
-
-  GLuint depthTexOffScreen{};
-  glGenTextures(1, &depthTexOffScreen);
-  glBindTexture(GL_TEXTURE_2D, depthTexOffScreen);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, texWidth, texHeight, 0,
-               GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-
-  GLuint fbOffScreen{};
-  glGenFramebuffers(1, &fbOffScreen);
-  glBindFramebuffer(GL_FRAMEBUFFER, fbOffScreen);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-                         colorTexOffScreen, 0);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
-                         depthTexOffScreen, 0);
-  const GLenum fbOffScreenStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-  if (fbOffScreenStatus != GL_FRAMEBUFFER_COMPLETE) {
-    if (fbOffScreenStatus == GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT)
-      fatal("Framebuffer not complete due to incomplete attachment.");
-    if (fbOffScreenStatus == GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT)
-      fatal("Framebuffer not complete due to missing attachment.");
-    fatal("Failed to complete offscreen framebuffer");
-  }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
   // glEnable(GL_CULL_FACE);
 
-  glBindVertexArray(vao);
-  glBindBuffer(GL_ARRAY_BUFFER, vbPosition);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-  glEnableVertexAttribArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, vbNormal);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-  glEnableVertexAttribArray(1);
-  glBindBuffer(GL_ARRAY_BUFFER, vbColor);
-  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-  glEnableVertexAttribArray(2);  // color
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib);
+  GatherSettings gatherSettings;
+  if (isBakeWorker && argc > 3) {
+    gatherSettings.numWorkerThreads = strtoul(argv[3], nullptr, 10);
+  }
+  const Gatherer gatherer = createGatherer(gatherSettings, prog);
+  if (isStreamBake) {
+    streamBake(gatherer, argv[2], memoryCapBytes);
+    return 0;
+  }
+  if (isBakeWorker) {
+    runBakeWorker(gatherer, argv[2]);
+    return 0;
+  }
+  if (isPrecisionReport) {
+    Scene scene = readSceneAsset(argv[2]);
+    createSceneBuffers(scene);
+    reportPrecisionErrors(scene, prog, gatherSettings);
+    return 0;
+  }
+  if (isSweep) {
+    Scene scene = readSceneAsset(argv[2]);
+    createSceneBuffers(scene);
+    runGatherSweep(scene, argv[2], prog, gatherSettings);
+    return 0;
+  }
+
+  // a single .mesh, a .cmesh or a .scene with instances of several meshes
+  const char* assetName = "trees.mesh";
+  char path[MAX_PATH];
+  GetCurrentDirectoryA(MAX_PATH, path);
+  strcat_s(path, "\\assets\\");
+  strcat_s(path, assetName);
+  Scene scene = readSceneAsset(path);
+  for (uint32_t meshIx = 0; meshIx < scene.numMeshes; ++meshIx) {
+    std::println("numVertices {}, numIndices {}",
+                 scene.meshes[meshIx].numVertices,
+                 scene.meshes[meshIx].numIndices);
+  }
+  std::println("numInstances {}, numInstanceVertices {}", scene.numInstances,
+               scene.numVertices);
+  scene.colorFormat = gatherSettings.radianceFormat;
+  createSceneBuffers(scene);
+
+  // Animated: a moving light strip, re-baked from scratch every frame.
+  // MeshColors: static emission from the mesh file, baked once and cached.
+  enum class EmissionMode { Animated, MeshColors };
+  const EmissionMode emissionMode = EmissionMode::MeshColors;
+
+  const GLsizeiptr bufferSizeBytes = scene.numVertices * sizeof(HMM_Vec3);
+  HMM_Vec3* emission = new HMM_Vec3[scene.numVertices];
+  HMM_Vec3* radiances =
+      new HMM_Vec3[scene.numVertices];  // total lighting from all bounces
+  HMM_Vec3* scratch =
+      new HMM_Vec3[scene.numVertices];  // lighting gathered in last iteration
+  copySceneEmission(scene, emission);
+  CopyMemory(radiances, emission, bufferSizeBytes);
+
+  char cachePath[MAX_PATH];
+  strcpy_s(cachePath, path);
+  strcat_s(cachePath, ".cache");
+  const uint64_t meshHash = hashSceneGeometry(scene);
+  const uint64_t settingsHash =
+      hashBakeSettings(gatherSettings, emission, scene.numVertices);
+  // remaining Jacobi iterations, one is done per frame so that the scene is
+  // already lit while the bake converges
+  uint32_t numIterationsLeft = gatherSettings.numBounces;
+  // Radiances of a stale cache, shown instead of the partial bake until the
+  // bake is done. The bake itself starts from the emission: a fixed number of
+  // steps from stale radiances would keep light of the old emitters.
+  HMM_Vec3* preview = nullptr;
+  if (emissionMode == EmissionMode::MeshColors) {
+    BakeCache cache;
+    const BakeCacheMatch match = openBakeCache(
+        cachePath, meshHash, settingsHash, scene.numVertices, cache);
+    if (match == BakeCacheMatch::Exact) {
+      std::println("Loaded radiance cache {}", cachePath);
+      CopyMemory(radiances, cache.radiances, bufferSizeBytes);
+      numIterationsLeft = 0;
+    } else if (match == BakeCacheMatch::Stale) {
+      std::println("Previewing stale radiance cache {}", cachePath);
+      preview = new HMM_Vec3[scene.numVertices];
+      CopyMemory(preview, cache.radiances, bufferSizeBytes);
+    }
+    closeBakeCache(cache);
+  }
 
   glEnable(GL_SCISSOR_TEST);
   const float t0 = getTime();
@@ -248,103 +241,37 @@ void main() {
     //std::println("dt {}, FPS {}", dt, 1.f / dt);
     glUniform1f(uTimeLoc, t);
 
-    const HMM_Mat4 worldFromObject = HMM_M4D(1.f);
-    glUniformMatrix4fv(uWorldFromObjectLoc, 1, GL_FALSE,
-                       &worldFromObject.Elements[0][0]);
-
-    const float highFOV = HMM_PI / 1.25;  //  HMM_PI - 0.05f; // ~179 deg
-    const HMM_Mat4 projectionFromView =
-        HMM_Perspective_RH_ZO(highFOV, 1.0f, 0.01f, 100.0f);
-    glUniformMatrix4fv(uProjectionFromViewLoc, 1, GL_FALSE,
-                       &projectionFromView.Elements[0][0]);
-
-    // Loop over every vertex, render the scene from vertex position into normal
-    // direction into a small texture take average pixel of the texture and
-    // store it as the incoming radiance for that vertex
-    glBindFramebuffer(GL_FRAMEBUFFER, fbOffScreen);
-    glClearColor(0.f, 0.f, 0.f, 1.0f);
-    // copy original light emissions from mesh data
-    HMM_Vec3* accumulatedRadiances =
-        new HMM_Vec3[mesh.numVertices];  // total lighting from all bounces
-    HMM_Vec3* bounceRadiances =
-        new HMM_Vec3[mesh.numVertices];  // lighting from current bounce
-    // Custom lighting pattern
-    //CopyMemory(accumulatedRadiances, mesh.colors, sizeof(HMM_Vec3) * mesh.numVertices);
-    //CopyMemory(bounceRadiances, mesh.colors, sizeof(HMM_Vec3) * mesh.numVertices);
-    for (uint32_t vertIx = 0; vertIx < mesh.numVertices; ++vertIx) {
-      //const bool illumVert = static_cast<uint32_t>(t) * 100 < vertIx &&
-      //                       vertIx < (static_cast<uint32_t>(t) + 1) * 100;
-      const bool illumVert = HMM_MOD(static_cast<uint32_t>(2 * t * 100), mesh.numVertices) < vertIx &&
-                             vertIx < HMM_MOD(static_cast<uint32_t>((2 * t + 1) * 100), mesh.numVertices);
-      accumulatedRadiances[vertIx] = illumVert ? HMM_V3(HMM_SinF(t),HMM_CosF(t),1) : HMM_V3(0,0,0);
-      bounceRadiances[vertIx] = accumulatedRadiances[vertIx];
-    }
-
-    const uint32_t numBounces = 3;
-    for (uint32_t bounceNo = 0; bounceNo < numBounces; bounceNo++) {
-      glBindBuffer(GL_ARRAY_BUFFER, vbColor);
-      glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(HMM_Vec3) * mesh.numVertices,
-                      bounceRadiances);
-
-      uint32_t numDownloads =
-          std::ceil(static_cast<float>(mesh.numVertices) / numViewports);
-      for (uint32_t d = 0; d < numDownloads; ++d) {
-        for (uint32_t v = 0; v < numViewports; ++v) {
-          glViewport(v * viewportSide, 0, viewportSide, viewportSide);
-          glScissor(v * viewportSide, 0, viewportSide, viewportSide);
-          const uint32_t vertIx = d * numViewports + v;
-          if (vertIx >= mesh.numVertices) {
-            break;
-          }
-          const HMM_Vec3 camPos = mesh.positions[vertIx];
-          const HMM_Vec3 camTarget = camPos + mesh.normals[vertIx];
-          HMM_Mat4 viewFromWorld = HMM_LookAt_RH(camPos, camTarget, kUp);
-          glUniformMatrix4fv(uViewFromWorldLoc, 1, GL_FALSE,
-                             &viewFromWorld.Elements[0][0]);
-          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-          glDrawElements(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT,
-                         nullptr);
-        }
-
-        glReadPixels(0, 0, texWidth, texHeight, GL_RGB, GL_FLOAT, pixels);
-        for (uint32_t v = 0; v < numViewports; ++v) {
-          const uint32_t vertIx = d * numViewports + v;
-          if (vertIx >= mesh.numVertices) {
-            break;
-          }
-          HMM_Vec3 totalRadiance = HMM_V3(0, 0, 0);
-          // const float viewportCenter = viewportSide * 0.5;
-          for (uint32_t i = 0; i < viewportSide; ++i) {
-            for (uint32_t j = v * viewportSide; j < (v + 1) * viewportSide;
-                 ++j) {
-              // non-physical weight to emphasize central pixels more than
-              // peripheral pixels
-              // const float weight = HMM_CosF((i - viewportCenter) /
-              //                              viewportCenter * HMM_PI * 0.5f) *
-              //                     HMM_CosF((j - viewportCenter) /
-              //                              viewportCenter * HMM_PI * 0.5f) *
-              //                     2.f;
-              const uint32_t pIx = i * texWidth + j;
-              const HMM_Vec3& px = pixels[pIx];
-              totalRadiance += px;  // * weight;
-            }
-          }
-          const HMM_Vec3 radiance = totalRadiance / viewportArea;
-          accumulatedRadiances[vertIx] += radiance;
-          bounceRadiances[vertIx] = radiance;
+    if (emissionMode == EmissionMode::Animated) {
+      // Custom lighting pattern
+      for (uint32_t vertIx = 0; vertIx < scene.numVertices; ++vertIx) {
+        //const bool illumVert = static_cast<uint32_t>(t) * 100 < vertIx &&
+        //                       vertIx < (static_cast<uint32_t>(t) + 1) * 100;
+        const bool illumVert = HMM_MOD(static_cast<uint32_t>(2 * t * 100), scene.numVertices) < vertIx &&
+                               vertIx < HMM_MOD(static_cast<uint32_t>((2 * t + 1) * 100), scene.numVertices);
+        emission[vertIx] = illumVert ? HMM_V3(HMM_SinF(t),HMM_CosF(t),1) : HMM_V3(0,0,0);
+        radiances[vertIx] = emission[vertIx];
+      }
+      for (uint32_t bounceNo = 0; bounceNo < gatherSettings.numBounces;
+           bounceNo++) {
+        iterateRadiances(gatherer, scene, emission, radiances, scratch);
+      }
+    } else if (numIterationsLeft > 0) {
+      iterateRadiances(gatherer, scene, emission, radiances, scratch);
+      if (--numIterationsLeft == 0) {
+        printGatherStats(gatherer);
+        if (writeBakeCache(cachePath, meshHash, settingsHash,
+                           scene.numVertices, radiances)) {
+          std::println("Wrote radiance cache {}", cachePath);
         }
+        delete[] preview;
+        preview = nullptr;
       }
     }
-    glBindBuffer(GL_ARRAY_BUFFER, vbColor);
-    // TODO(vug): option to choose among accumulatedRadiances (result) and
-    // bounceRadiances (bounce contribution)
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(HMM_Vec3) * mesh.numVertices,
-                    accumulatedRadiances);
+    // TODO(vug): option to choose among accumulated radiances (result) and
+    // the contribution of the last bounce
+    uploadSceneColors(scene, preview ? preview : radiances);
 
     // Render the world from camera POV
-    const HMM_Mat4 worldFromObject2 = HMM_M4D(1.f);
-    glUniformMatrix4fv(uWorldFromObjectLoc, 1, GL_FALSE,
-                       &worldFromObject2.Elements[0][0]);
     // t = 19;
     HMM_Mat4 viewFromWorld2 = HMM_LookAt_RH(
         HMM_V3(20.f * HMM_CosF(t * 0.5f), 20.f * HMM_SinF(t * 0.5f), 10),
@@ -365,7 +292,7 @@ void main() {
     glClearColor(0.f, 0.f, 0.f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glDrawElements(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT, nullptr);
+    drawScene(scene, uWorldFromObjectLoc);
 
     SwapBuffers(dev);
   }
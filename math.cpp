@@ -1,11 +1,248 @@
 #include "math.hpp"
 
-constexpr Mat4 lookAt(const Vec3& camPos, const Vec3& target) {
-  Mat4 translate;
-  translate.wx = -camPos.x;
-  translate.wy = -camPos.y;
-  translate.wz = -camPos.z;
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
+static_assert(lookAt({1, 2, 3}, {1, 2, 4}, {0, 1, 0}).wz == 3.0f);
+static_assert(perspective(HMM_PI32 / 2, 1.0f, 1.0f, 2.0f).yy > 0.999f);
 
-  return translate;
-}
\ No newline at end of file
+uint16_t floatToHalf(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  const uint16_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  // infinity and NaN
+  if (x >= 0x7f800000) return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);
+  // 65520 and above round to infinity
+  if (x >= 0x477ff000) return sign | 0x7c00;
+  // below 2^-25 rounds to zero
+  if (x < 0x33000000) return sign;
+  uint32_t h;
+  uint32_t remainder;
+  uint32_t halfway;
+  if (x < 0x38800000) {
+    // subnormal half, in units of 2^-24
+    const uint32_t shift = 126 - (x >> 23);
+    const uint32_t mantissa = (x & 0x7fffff) | 0x800000;
+    h = mantissa >> shift;
+    remainder = mantissa & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+  } else {
+    // rebias the exponent from 127 to 15, a mantissa carry increments it
+    h = (x - 0x38000000) >> 13;
+    remainder = x & 0x1fff;
+    halfway = 0x1000;
+  }
+  if (remainder > halfway || (remainder == halfway && (h & 1))) ++h;
+  return static_cast<uint16_t>(sign | h);
+}
+
+float halfToFloat(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  const uint32_t exponent = (h >> 10) & 0x1f;
+  const uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0) {
+    // zero and subnormals, 2^-24 per unit
+    const float f = mantissa * 5.9604645e-8f;
+    return sign ? -f : f;
+  }
+  const uint32_t x = exponent == 31
+                         ? sign | 0x7f800000 | (mantissa << 13)
+                         : sign | ((exponent + 112) << 23) | (mantissa << 13);
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+// unsigned float with a 5 bit exponent and mantissaBits bits of mantissa
+static float unpackSmallFloat(uint32_t bits, uint32_t mantissaBits) {
+  const uint32_t exponent = bits >> mantissaBits;
+  const uint32_t mantissa = bits & ((1u << mantissaBits) - 1);
+  if (exponent == 0) {
+    return std::ldexp(static_cast<float>(mantissa),
+                      -14 - static_cast<int>(mantissaBits));
+  }
+  const uint32_t x = exponent == 31
+                         ? 0x7f800000 | (mantissa << (23 - mantissaBits))
+                         : ((exponent + 112) << 23) |
+                               (mantissa << (23 - mantissaBits));
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+HMM_Vec3 unpackR11G11B10F(uint32_t packed) {
+  return HMM_V3(unpackSmallFloat(packed & 0x7ff, 6),
+                unpackSmallFloat((packed >> 11) & 0x7ff, 6),
+                unpackSmallFloat(packed >> 22, 5));
+}
+
+Vec3Soa createVec3Soa(const HMM_Vec3* points, uint32_t count) {
+  Vec3Soa soa;
+  soa.count = count;
+  const uint32_t paddedCount = count + kSimdWidth;
+  soa.x = new float[paddedCount]{};
+  soa.y = new float[paddedCount]{};
+  soa.z = new float[paddedCount]{};
+  for (uint32_t i = 0; i < count; ++i) {
+    soa.x[i] = points[i].X;
+    soa.y[i] = points[i].Y;
+    soa.z[i] = points[i].Z;
+  }
+  return soa;
+}
+
+void destroyVec3Soa(Vec3Soa& soa) {
+  delete[] soa.x;
+  delete[] soa.y;
+  delete[] soa.z;
+  soa = {};
+}
+
+#ifdef __AVX__
+
+static inline __m256 dot8(__m256 ax, __m256 ay, __m256 az, __m256 bx,
+                          __m256 by, __m256 bz) {
+  return _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)),
+      _mm256_mul_ps(az, bz));
+}
+
+static inline void normalize8(__m256& x, __m256& y, __m256& z) {
+  // full precision like HMM_NormV3, _mm256_rsqrt_ps would change the bake
+  const __m256 invLength = _mm256_div_ps(
+      _mm256_set1_ps(1.0f), _mm256_sqrt_ps(dot8(x, y, z, x, y, z)));
+  x = _mm256_mul_ps(x, invLength);
+  y = _mm256_mul_ps(y, invLength);
+  z = _mm256_mul_ps(z, invLength);
+}
+
+void lookAtBatch(const Vec3x8& positions, const Vec3x8& directions, Vec3 up,
+                 Mat4* viewFromWorld) {
+  const __m256 upX = _mm256_set1_ps(up.x);
+  const __m256 upY = _mm256_set1_ps(up.y);
+  const __m256 upZ = _mm256_set1_ps(up.z);
+  const __m256 ex = _mm256_load_ps(positions.x);
+  const __m256 ey = _mm256_load_ps(positions.y);
+  const __m256 ez = _mm256_load_ps(positions.z);
+  __m256 fx = _mm256_load_ps(directions.x);
+  __m256 fy = _mm256_load_ps(directions.y);
+  __m256 fz = _mm256_load_ps(directions.z);
+  normalize8(fx, fy, fz);
+  // s = cross(f, up)
+  __m256 sx = _mm256_sub_ps(_mm256_mul_ps(fy, upZ), _mm256_mul_ps(fz, upY));
+  __m256 sy = _mm256_sub_ps(_mm256_mul_ps(fz, upX), _mm256_mul_ps(fx, upZ));
+  __m256 sz = _mm256_sub_ps(_mm256_mul_ps(fx, upY), _mm256_mul_ps(fy, upX));
+  normalize8(sx, sy, sz);
+  // u = cross(s, f)
+  const __m256 ux =
+      _mm256_sub_ps(_mm256_mul_ps(sy, fz), _mm256_mul_ps(sz, fy));
+  const __m256 uy =
+      _mm256_sub_ps(_mm256_mul_ps(sz, fx), _mm256_mul_ps(sx, fz));
+  const __m256 uz =
+      _mm256_sub_ps(_mm256_mul_ps(sx, fy), _mm256_mul_ps(sy, fx));
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  // the 16 matrix elements of all lanes, in Mat4 order
+  const __m256 elements[16] = {
+      sx, ux, _mm256_sub_ps(zero, fx), zero,
+      sy, uy, _mm256_sub_ps(zero, fy), zero,
+      sz, uz, _mm256_sub_ps(zero, fz), zero,
+      _mm256_sub_ps(zero, dot8(sx, sy, sz, ex, ey, ez)),
+      _mm256_sub_ps(zero, dot8(ux, uy, uz, ex, ey, ez)),
+      dot8(fx, fy, fz, ex, ey, ez), one};
+  alignas(32) float lanes[16][kSimdWidth];
+  for (uint32_t e = 0; e < 16; ++e) {
+    _mm256_store_ps(lanes[e], elements[e]);
+  }
+  for (uint32_t i = 0; i < kSimdWidth; ++i) {
+    float* m = &viewFromWorld[i].xx;
+    for (uint32_t e = 0; e < 16; ++e) {
+      m[e] = lanes[e][i];
+    }
+  }
+}
+
+static inline void transform8(const Mat4& m, const Vec3Soa& v, uint32_t first,
+                              bool isPoint, __m256& x, __m256& y, __m256& z) {
+  const __m256 vx = _mm256_loadu_ps(v.x + first);
+  const __m256 vy = _mm256_loadu_ps(v.y + first);
+  const __m256 vz = _mm256_loadu_ps(v.z + first);
+  auto row = [&](float c0, float c1, float c2, float c3) {
+    __m256 r = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(c0), vx),
+                      _mm256_mul_ps(_mm256_set1_ps(c1), vy)),
+        _mm256_mul_ps(_mm256_set1_ps(c2), vz));
+    return isPoint ? _mm256_add_ps(r, _mm256_set1_ps(c3)) : r;
+  };
+  x = row(m.xx, m.yx, m.zx, m.wx);
+  y = row(m.xy, m.yy, m.zy, m.wy);
+  z = row(m.xz, m.yz, m.zz, m.wz);
+}
+
+void transformPointsBatch(const Mat4& m, const Vec3Soa& points, uint32_t first,
+                          Vec3x8& transformed) {
+  __m256 x, y, z;
+  transform8(m, points, first, true, x, y, z);
+  _mm256_store_ps(transformed.x, x);
+  _mm256_store_ps(transformed.y, y);
+  _mm256_store_ps(transformed.z, z);
+}
+
+void transformNormalsBatch(const Mat4& m, const Vec3Soa& normals,
+                           uint32_t first, Vec3x8& transformed) {
+  __m256 x, y, z;
+  transform8(m, normals, first, false, x, y, z);
+  normalize8(x, y, z);
+  _mm256_store_ps(transformed.x, x);
+  _mm256_store_ps(transformed.y, y);
+  _mm256_store_ps(transformed.z, z);
+}
+
+#else
+
+// same results one lane at a time for builds without AVX
+
+void lookAtBatch(const Vec3x8& positions, const Vec3x8& directions, Vec3 up,
+                 Mat4* viewFromWorld) {
+  for (uint32_t i = 0; i < kSimdWidth; ++i) {
+    const Vec3 position{positions.x[i], positions.y[i], positions.z[i]};
+    const Vec3 direction{directions.x[i], directions.y[i], directions.z[i]};
+    // normalizing first avoids the rounding of position + direction
+    viewFromWorld[i] = lookAt(position, position + normalize(direction), up);
+  }
+}
+
+static Vec3 transform(const Mat4& m, Vec3 v, float w) {
+  return {m.xx * v.x + m.yx * v.y + m.zx * v.z + m.wx * w,
+          m.xy * v.x + m.yy * v.y + m.zy * v.z + m.wy * w,
+          m.xz * v.x + m.yz * v.y + m.zz * v.z + m.wz * w};
+}
+
+void transformPointsBatch(const Mat4& m, const Vec3Soa& points, uint32_t first,
+                          Vec3x8& transformed) {
+  for (uint32_t i = 0; i < kSimdWidth; ++i) {
+    const uint32_t ix = first + i;
+    const Vec3 p =
+        transform(m, {points.x[ix], points.y[ix], points.z[ix]}, 1.0f);
+    transformed.x[i] = p.x;
+    transformed.y[i] = p.y;
+    transformed.z[i] = p.z;
+  }
+}
+
+void transformNormalsBatch(const Mat4& m, const Vec3Soa& normals,
+                           uint32_t first, Vec3x8& transformed) {
+  for (uint32_t i = 0; i < kSimdWidth; ++i) {
+    const uint32_t ix = first + i;
+    const Vec3 n = normalize(
+        transform(m, {normals.x[ix], normals.y[ix], normals.z[ix]}, 0.0f));
+    transformed.x[i] = n.x;
+    transformed.y[i] = n.y;
+    transformed.z[i] = n.z;
+  }
+}
+
+#endif
@@ -1,11 +1,25 @@
 #pragma once
 
+#include <vendor/HandmadeMath.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Math for building gather views that can also run at compile time, and
+// structure of arrays (SoA) batches that build views and transform vertices
+// kSimdWidth at a time with AVX. Results match the HandmadeMath functions
+// named next to them.
+
 struct Vec3 {
   float x{};
   float y{};
   float z{};
 };
 
+// Column major like HMM_Mat4 and GL, wx is the x component of the w column,
+// so &m.xx can be passed to glUniformMatrix4fv.
 struct Mat4 {
   float xx{1};
   float xy{};
@@ -27,5 +41,128 @@ struct Mat4 {
   float wz{};
   float ww{1};
 };
+static_assert(sizeof(Mat4) == sizeof(HMM_Mat4));
+
+inline Vec3 toVec3(HMM_Vec3 v) { return {v.X, v.Y, v.Z}; }
+inline HMM_Vec3 toHmm(Vec3 v) { return HMM_V3(v.x, v.y, v.z); }
+inline Mat4 toMat4(const HMM_Mat4& m) {
+  Mat4 r;
+  memcpy(&r, &m, sizeof(r));
+  return r;
+}
+
+// sqrt and tan that fall back to Newton iterations and a Taylor series in
+// constant expressions
+constexpr float constSqrt(float x) {
+  if (!std::is_constant_evaluated()) return std::sqrt(x);
+  if (x <= 0.f) return 0.f;
+  double r = x > 1.f ? x : 1.0;
+  for (int i = 0; i < 64; ++i) r = 0.5 * (r + x / r);
+  return static_cast<float>(r);
+}
+
+// the series is accurate for |x| <= pi / 2, which covers every half FOV
+constexpr float constTan(float x) {
+  if (!std::is_constant_evaluated()) return std::tan(x);
+  double sin = 0.0;
+  double cos = 0.0;
+  // x^k / k!
+  double term = 1.0;
+  for (int k = 0; k < 32; ++k) {
+    switch (k % 4) {
+      case 0: cos += term; break;
+      case 1: sin += term; break;
+      case 2: cos -= term; break;
+      case 3: sin -= term; break;
+    }
+    term *= x / (k + 1);
+  }
+  return static_cast<float>(sin / cos);
+}
+
+constexpr Vec3 operator+(Vec3 a, Vec3 b) {
+  return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+constexpr Vec3 operator-(Vec3 a, Vec3 b) {
+  return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+constexpr Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+constexpr float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr Vec3 cross(Vec3 a, Vec3 b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+constexpr Vec3 normalize(Vec3 a) { return a * (1.0f / constSqrt(dot(a, a))); }
+
+// HMM_LookAt_RH
+constexpr Mat4 lookAt(Vec3 camPos, Vec3 target, Vec3 up) {
+  const Vec3 f = normalize(target - camPos);
+  const Vec3 s = normalize(cross(f, up));
+  const Vec3 u = cross(s, f);
+  Mat4 m;
+  m.xx = s.x;
+  m.xy = u.x;
+  m.xz = -f.x;
+  m.yx = s.y;
+  m.yy = u.y;
+  m.yz = -f.y;
+  m.zx = s.z;
+  m.zy = u.z;
+  m.zz = -f.z;
+  m.wx = -dot(s, camPos);
+  m.wy = -dot(u, camPos);
+  m.wz = dot(f, camPos);
+  return m;
+}
+
+// HMM_Perspective_RH_ZO
+constexpr Mat4 perspective(float fovY, float aspect, float nearPlane,
+                           float farPlane) {
+  const float cotangent = 1.0f / constTan(fovY / 2.0f);
+  Mat4 m;
+  m.xx = cotangent / aspect;
+  m.yy = cotangent;
+  m.zz = farPlane / (nearPlane - farPlane);
+  m.zw = -1.0f;
+  m.wz = nearPlane * farPlane / (nearPlane - farPlane);
+  m.ww = 0.0f;
+  return m;
+}
+
+// IEEE half floats, rounding to nearest even like the GPU
+uint16_t floatToHalf(float f);
+float halfToFloat(uint16_t h);
+// GL_UNSIGNED_INT_10F_11F_11F_REV pixel, red in the lowest 11 bits
+HMM_Vec3 unpackR11G11B10F(uint32_t packed);
+
+constexpr uint32_t kSimdWidth = 8;
+
+// kSimdWidth points, lane i of each array belongs to point i
+struct alignas(32) Vec3x8 {
+  float x[kSimdWidth];
+  float y[kSimdWidth];
+  float z[kSimdWidth];
+};
+
+// SoA copy of count points, zero padded so that kSimdWidth points can be
+// read starting at any index below count.
+struct Vec3Soa {
+  uint32_t count{};
+  float* x{};
+  float* y{};
+  float* z{};
+};
+
+Vec3Soa createVec3Soa(const HMM_Vec3* points, uint32_t count);
+void destroyVec3Soa(Vec3Soa& soa);
 
-constexpr Mat4 lookAt(const Vec3& camPos, const Vec3& target);
+// Views from every position along the matching direction, i.e.
+// lookAt(position, position + direction, up) for all lanes.
+void lookAtBatch(const Vec3x8& positions, const Vec3x8& directions, Vec3 up,
+                 Mat4* viewFromWorld);
+// Points [first, first + kSimdWidth) of `points` transformed by m.
+void transformPointsBatch(const Mat4& m, const Vec3Soa& points, uint32_t first,
+                          Vec3x8& transformed);
+// Same for directions, normalized after the transform. Only valid for
+// matrices without non-uniform scale.
+void transformNormalsBatch(const Mat4& m, const Vec3Soa& normals,
+                           uint32_t first, Vec3x8& transformed);
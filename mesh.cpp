@@ -0,0 +1,55 @@
+#include "mesh.hpp"
+#include "opengl.hpp"
+
+Mesh readMeshFromFile(const char* fileName) {
+  HANDLE hFile = CreateFileA(fileName, GENERIC_READ, 0, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    fatal("Failed to open file");
+  }
+
+  Mesh mesh;
+  DWORD bytesRead = 0;
+  if (!ReadFile(hFile, &mesh.numVertices, sizeof(unsigned int), &bytesRead,
+                nullptr) ||
+      bytesRead != sizeof(unsigned int)) {
+    fatal("Failed to read numVertices from file.");
+  };
+
+  if (!ReadFile(hFile, &mesh.numIndices, sizeof(unsigned int), &bytesRead,
+                nullptr) ||
+      bytesRead != sizeof(unsigned int)) {
+    fatal("Failed to read numIndices from file.");
+  }
+
+  const DWORD attrSizeBytes = mesh.numVertices * sizeof(HMM_Vec3);
+  mesh.positions = new HMM_Vec3[mesh.numVertices];
+  mesh.normals = new HMM_Vec3[mesh.numVertices];
+  mesh.colors = new HMM_Vec3[mesh.numVertices];
+  for (HMM_Vec3* attr : {mesh.positions, mesh.normals, mesh.colors}) {
+    if (!ReadFile(hFile, attr, attrSizeBytes, &bytesRead, NULL) ||
+        bytesRead != attrSizeBytes) {
+      fatal("Failed to read position data.");
+    }
+  }
+
+  const DWORD indicesSizeBytes = mesh.numIndices * sizeof(unsigned int);
+  mesh.indices = new unsigned int[mesh.numIndices];
+  if (!ReadFile(hFile, mesh.indices, indicesSizeBytes, &bytesRead, NULL) ||
+      bytesRead != indicesSizeBytes) {
+    fatal("Failed to read position data.");
+  }
+  CloseHandle(hFile);
+
+  for (uint32_t vertIx = 0; vertIx < mesh.numVertices; ++vertIx) {
+    mesh.colors[vertIx] *=
+        4;  // temporarily increase intensity here, should be done in Blender
+  }
+
+  return mesh;
+}
+
+void createMeshSoa(Mesh& mesh) {
+  mesh.positionsSoa = createVec3Soa(mesh.positions, mesh.numVertices);
+  mesh.normalsSoa = createVec3Soa(mesh.normals, mesh.numVertices);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "math.hpp"
+
+#include <cstdint>
+
+struct Mesh {
+  unsigned int numVertices{};
+  unsigned int numIndices{};
+  HMM_Vec3* positions{};
+  HMM_Vec3* normals{};
+  HMM_Vec3* colors{};
+  unsigned int* indices{};
+  // SoA copies of positions and normals for batched transforms, only filled
+  // by createMeshSoa
+  Vec3Soa positionsSoa{};
+  Vec3Soa normalsSoa{};
+  // ~Mesh() { delete[] positions; delete[] normals; delete[] colors; }
+};
+
+Mesh readMeshFromFile(const char* fileName);
+void createMeshSoa(Mesh& mesh);
@@ -28,6 +28,21 @@ void createAndShowWindow(const char *name, int with, int height,
   UpdateWindow(windowHandle);
 }
 
+void createHiddenWindow(HDC &deviceContextHandle) {
+  HWND windowHandle = CreateWindowEx(
+      0,                    // Optional window styles
+      L"STATIC",            // Predefined class name (STATIC)
+      L"RasterGI",          // Window title
+      WS_OVERLAPPEDWINDOW,  // Window style, no WS_VISIBLE
+      CW_USEDEFAULT, CW_USEDEFAULT, 64, 64,  // Size and position
+      NULL,                                  // Parent window
+      NULL,                                  // Menu
+      GetModuleHandle(NULL),                 // Instance handle
+      NULL  // Additional application data
+  );
+  deviceContextHandle = GetDC(windowHandle);
+}
+
 void setPixelFormatFancy(HDC deviceContextHandle) {
   // Now we can choose a pixel format the modern way, using
   // wglChoosePixelFormatARB.
@@ -122,9 +137,11 @@ DEFINE_FUNC_PTR_TYPE(glUniform1f);
 DEFINE_FUNC_PTR_TYPE(glUniformMatrix4fv);
 DEFINE_FUNC_PTR_TYPE(glBindBufferBase);
 DEFINE_FUNC_PTR_TYPE(glGenTextures);
+DEFINE_FUNC_PTR_TYPE(glDeleteTextures);
 DEFINE_FUNC_PTR_TYPE(glBindTexture);
 DEFINE_FUNC_PTR_TYPE(glTexImage2D);
 DEFINE_FUNC_PTR_TYPE(glGenFramebuffers);
+DEFINE_FUNC_PTR_TYPE(glDeleteFramebuffers);
 DEFINE_FUNC_PTR_TYPE(glBindFramebuffer);
 DEFINE_FUNC_PTR_TYPE(glFramebufferTexture2D);
 DEFINE_FUNC_PTR_TYPE(glViewport);
@@ -132,6 +149,11 @@ DEFINE_FUNC_PTR_TYPE(glReadPixels);
 DEFINE_FUNC_PTR_TYPE(glCheckFramebufferStatus);
 DEFINE_FUNC_PTR_TYPE(glBufferSubData);
 DEFINE_FUNC_PTR_TYPE(glScissor);
+DEFINE_FUNC_PTR_TYPE(glMapBufferRange);
+DEFINE_FUNC_PTR_TYPE(glUnmapBuffer);
+DEFINE_FUNC_PTR_TYPE(glFenceSync);
+DEFINE_FUNC_PTR_TYPE(glClientWaitSync);
+DEFINE_FUNC_PTR_TYPE(glDeleteSync);
 
 void *GetAnyGLFuncAddress(const char *name) {
   void *p = (void *)wglGetProcAddress(name);
@@ -178,9 +200,11 @@ void initGlFunctions() {
   GET_PROC_ADDRESS(glUniformMatrix4fv);
   GET_PROC_ADDRESS(glBindBufferBase);
   GET_PROC_ADDRESS(glGenTextures);
+  GET_PROC_ADDRESS(glDeleteTextures);
   GET_PROC_ADDRESS(glBindTexture);
   GET_PROC_ADDRESS(glTexImage2D);
   GET_PROC_ADDRESS(glGenFramebuffers);
+  GET_PROC_ADDRESS(glDeleteFramebuffers);
   GET_PROC_ADDRESS(glBindFramebuffer);
   GET_PROC_ADDRESS(glFramebufferTexture2D);
   GET_PROC_ADDRESS(glViewport);
@@ -188,6 +212,11 @@ void initGlFunctions() {
   GET_PROC_ADDRESS(glCheckFramebufferStatus);
   GET_PROC_ADDRESS(glBufferSubData);
   GET_PROC_ADDRESS(glScissor);
+  GET_PROC_ADDRESS(glMapBufferRange);
+  GET_PROC_ADDRESS(glUnmapBuffer);
+  GET_PROC_ADDRESS(glFenceSync);
+  GET_PROC_ADDRESS(glClientWaitSync);
+  GET_PROC_ADDRESS(glDeleteSync);
 }
 
 void loadWglCreateContextAttribsARB() {
@@ -6,6 +6,8 @@
 void fatal(const char *msg);
 void createAndShowWindow(const char *name, int with, int height,
                          HDC &deviceContextHandle);
+// Window that is never shown, for processes that only render offscreen.
+void createHiddenWindow(HDC &deviceContextHandle);
 void setPixelFormatFancy(HDC deviceContextHandle);
 void createAndMakeOpenGlContext(HDC deviceContextHandle);
 
@@ -22,6 +24,8 @@ typedef khronos_ssize_t GLsizeiptr;
 typedef signed long long int khronos_intptr_t; // _WIN64
 typedef khronos_intptr_t GLintptr;
 typedef unsigned char GLboolean;
+typedef unsigned long long GLuint64;
+typedef struct __GLsync *GLsync;
 #define GL_TRUE 1
 #define GL_FALSE 0
 #define GL_VERSION 0x1F02
@@ -46,7 +50,14 @@ typedef unsigned char GLboolean;
 #define GL_RGB 0x1907
 //#define GL_R32F 0x822E
 #define GL_RGB32F 0x8815
+#define GL_RGBA 0x1908
+#define GL_RGBA16F 0x881A
+#define GL_R11F_G11F_B10F 0x8C3A
 #define GL_DEPTH_COMPONENT32F 0x8CAC
+#define GL_DEPTH_COMPONENT24 0x81A6
+#define GL_DEPTH_COMPONENT16 0x81A5
+#define GL_HALF_FLOAT 0x140B
+#define GL_UNSIGNED_INT_10F_11F_11F_REV 0x8C3B
 #define GL_DEPTH_COMPONENT 0x1902
 #define GL_FRAMEBUFFER 0x8D40
 #define GL_COLOR_ATTACHMENT0 0x8CE0
@@ -56,6 +67,15 @@ typedef unsigned char GLboolean;
 #define GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT 0x8CD7
 #define GL_CULL_FACE 0x0B44
 #define GL_SCISSOR_TEST 0x0C11
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#define GL_STREAM_READ 0x88E1
+#define GL_MAP_READ_BIT 0x0001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_WAIT_FAILED 0x911D
 
 // Creates symbol for function pointer type of given method name
 #define FnPtrT(method) FnPtr_##method##_Proc
@@ -144,9 +164,11 @@ DECLARE_FUNC_PTR_TYPE(glUniform1f, void, GLint location, GLfloat v0);
 DECLARE_FUNC_PTR_TYPE(glUniformMatrix4fv, void, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
 DECLARE_FUNC_PTR_TYPE(glBindBufferBase, void, GLenum target, GLuint index, GLuint buffer);
 DECLARE_FUNC_PTR_TYPE(glGenTextures, void, GLsizei n, GLuint* textures);
+DECLARE_FUNC_PTR_TYPE(glDeleteTextures, void, GLsizei n, const GLuint* textures);
 DECLARE_FUNC_PTR_TYPE(glBindTexture, void, GLenum target, GLuint texture);
 DECLARE_FUNC_PTR_TYPE(glTexImage2D, void, GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels);
 DECLARE_FUNC_PTR_TYPE(glGenFramebuffers, void, GLsizei n, GLuint* framebuffers);
+DECLARE_FUNC_PTR_TYPE(glDeleteFramebuffers, void, GLsizei n, const GLuint* framebuffers);
 DECLARE_FUNC_PTR_TYPE(glBindFramebuffer, void, GLenum target, GLuint framebuffer);
 DECLARE_FUNC_PTR_TYPE(glFramebufferTexture2D, void, GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
 DECLARE_FUNC_PTR_TYPE(glViewport, void, GLint x, GLint y, GLsizei width, GLsizei height);
@@ -156,6 +178,13 @@ DECLARE_FUNC_PTR_TYPE(glBufferSubData, void, GLenum target, GLintptr offset,
                       GLsizeiptr size, const void *data);
 DECLARE_FUNC_PTR_TYPE(glScissor, void, GLint x, GLint y, GLsizei width,
                       GLsizei height);
+DECLARE_FUNC_PTR_TYPE(glMapBufferRange, void *, GLenum target,
+                      GLintptr offset, GLsizeiptr length, GLbitfield access);
+DECLARE_FUNC_PTR_TYPE(glUnmapBuffer, GLboolean, GLenum target);
+DECLARE_FUNC_PTR_TYPE(glFenceSync, GLsync, GLenum condition, GLbitfield flags);
+DECLARE_FUNC_PTR_TYPE(glClientWaitSync, GLenum, GLsync sync, GLbitfield flags,
+                      GLuint64 timeout);
+DECLARE_FUNC_PTR_TYPE(glDeleteSync, void, GLsync sync);
 
 //DECLARE_FUNC_PTR_TYPE(glFuncName, void, GLint foo);
 
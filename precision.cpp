@@ -0,0 +1,85 @@
+#include "precision.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <print>
+
+static void bake(const Gatherer& g, const Scene& scene,
+                 const HMM_Vec3* emission, HMM_Vec3* radiances,
+                 HMM_Vec3* scratch) {
+  CopyMemory(radiances, emission, scene.numVertices * sizeof(HMM_Vec3));
+  for (uint32_t bounceNo = 0; bounceNo < g.settings.numBounces; ++bounceNo) {
+    iterateRadiances(g, scene, emission, radiances, scratch);
+  }
+}
+
+RadianceError measureRadianceError(const HMM_Vec3* reference,
+                                   const HMM_Vec3* radiances,
+                                   uint32_t numVertices) {
+  double meanLength = 0;
+  for (uint32_t v = 0; v < numVertices; ++v) {
+    meanLength += HMM_LenV3(reference[v]);
+  }
+  meanLength /= HMM_MAX(numVertices, 1u);
+  const double floorLength = HMM_MAX(0.01 * meanLength, 1e-6);
+  double sumSquaredErrors = 0;
+  double sumSquaredReferences = 0;
+  RadianceError error;
+  for (uint32_t v = 0; v < numVertices; ++v) {
+    const double difference = HMM_LenV3(radiances[v] - reference[v]);
+    const double length = HMM_LenV3(reference[v]);
+    sumSquaredErrors += difference * difference;
+    sumSquaredReferences += length * length;
+    error.maxRelative =
+        HMM_MAX(error.maxRelative, difference / HMM_MAX(length, floorLength));
+  }
+  if (sumSquaredReferences > 0) {
+    error.rmse = std::sqrt(sumSquaredErrors / sumSquaredReferences);
+  }
+  return error;
+}
+
+void reportPrecisionErrors(Scene& scene, GLuint prog,
+                           const GatherSettings& settings) {
+  const uint32_t numVertices = scene.numVertices;
+  const RadianceFormat sceneColorFormat = scene.colorFormat;
+  HMM_Vec3* emission = new HMM_Vec3[numVertices];
+  HMM_Vec3* reference = new HMM_Vec3[numVertices];
+  HMM_Vec3* radiances = new HMM_Vec3[numVertices];
+  HMM_Vec3* scratch = new HMM_Vec3[numVertices];
+  copySceneEmission(scene, emission);
+
+  std::println("{:<22} {:>10} {:>10} {:>9} {:>11} {:>9}", "tier", "rel RMSE",
+               "max rel", "bake ms", "readback B", "upload B");
+  for (uint32_t tierIx = 0; tierIx < kNumPrecisionTiers; ++tierIx) {
+    const PrecisionTier& tier = kPrecisionTiers[tierIx];
+    GatherSettings tierSettings = settings;
+    tierSettings.colorFormat = tier.colorFormat;
+    tierSettings.depthFormat = tier.depthFormat;
+    tierSettings.radianceFormat = tier.radianceFormat;
+    Gatherer g = createGatherer(tierSettings, prog);
+    setSceneColorFormat(scene, tier.radianceFormat);
+
+    // the first tier is the reference
+    HMM_Vec3* result = tierIx == 0 ? reference : radiances;
+    const auto start = std::chrono::steady_clock::now();
+    bake(g, scene, emission, result, scratch);
+    const std::chrono::duration<double, std::milli> bakeTime =
+        std::chrono::steady_clock::now() - start;
+
+    const RadianceError error =
+        measureRadianceError(reference, result, numVertices);
+    const uint32_t readbackBytes = g.settings.viewportSide *
+                                   g.settings.viewportSide * g.pixelSizeBytes;
+    std::println("{:<22} {:>10.6f} {:>10.6f} {:>9.1f} {:>11} {:>9}", tier.name,
+                 error.rmse, error.maxRelative, bakeTime.count(),
+                 readbackBytes, getRadianceSizeBytes(tier.radianceFormat));
+    destroyGatherer(g);
+  }
+
+  setSceneColorFormat(scene, sceneColorFormat);
+  delete[] scratch;
+  delete[] radiances;
+  delete[] reference;
+  delete[] emission;
+}
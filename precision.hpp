@@ -0,0 +1,47 @@
+#pragma once
+
+#include "gather.hpp"
+
+// A combination of gather atlas and radiance precisions.
+struct PrecisionTier {
+  const char* name;
+  GatherColorFormat colorFormat;
+  GatherDepthFormat depthFormat;
+  RadianceFormat radianceFormat;
+};
+
+// From the fp32 reference to the cheapest tier.
+constexpr PrecisionTier kPrecisionTiers[] = {
+    {"fp32", GatherColorFormat::RGB32F, GatherDepthFormat::Depth32F,
+     RadianceFormat::Float32},
+    {"rgba16f", GatherColorFormat::RGBA16F, GatherDepthFormat::Depth32F,
+     RadianceFormat::Float32},
+    {"rgba16f-d24-half", GatherColorFormat::RGBA16F, GatherDepthFormat::Depth24,
+     RadianceFormat::Float16},
+    {"r11g11b10f-d24-half", GatherColorFormat::R11G11B10F,
+     GatherDepthFormat::Depth24, RadianceFormat::Float16},
+    {"r11g11b10f-d16-half", GatherColorFormat::R11G11B10F,
+     GatherDepthFormat::Depth16, RadianceFormat::Float16},
+};
+constexpr uint32_t kNumPrecisionTiers =
+    sizeof(kPrecisionTiers) / sizeof(kPrecisionTiers[0]);
+
+// Per-vertex error of radiances against a reference solution. rmse is
+// relative to the RMS of the reference. The maximum relative error divides by
+// the reference length, floored at 1% of its mean so that almost black
+// vertices do not dominate it.
+struct RadianceError {
+  double rmse{};
+  double maxRelative{};
+};
+
+RadianceError measureRadianceError(const HMM_Vec3* reference,
+                                   const HMM_Vec3* radiances,
+                                   uint32_t numVertices);
+
+// Bakes the scene with every tier and prints the error of each against the
+// fp32 tier, its bake time and the bytes it reads back per gather point and
+// uploads per vertex. Restores the scene's color format. Expects the gather
+// program to be bound.
+void reportPrecisionErrors(Scene& scene, GLuint prog,
+                           const GatherSettings& settings);
@@ -0,0 +1,399 @@
+#include "scene.hpp"
+#include "chunked.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+
+static void computeMeshBounds(const Mesh& mesh, HMM_Vec3& boundsMin,
+                              HMM_Vec3& boundsMax) {
+  boundsMin = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+  boundsMax = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (uint32_t vertIx = 0; vertIx < mesh.numVertices; ++vertIx) {
+    const HMM_Vec3& p = mesh.positions[vertIx];
+    for (int c = 0; c < 3; ++c) {
+      boundsMin[c] = HMM_MIN(boundsMin[c], p.Elements[c]);
+      boundsMax[c] = HMM_MAX(boundsMax[c], p.Elements[c]);
+    }
+  }
+}
+
+// Transforms the corners of the mesh bounds into world space.
+static void computeInstanceBounds(const Mesh& mesh, Instance& inst) {
+  HMM_Vec3 localMin, localMax;
+  computeMeshBounds(mesh, localMin, localMax);
+  inst.boundsMin = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+  inst.boundsMax = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (int corner = 0; corner < 8; ++corner) {
+    const HMM_Vec4 local = HMM_V4(corner & 1 ? localMax.X : localMin.X,
+                                  corner & 2 ? localMax.Y : localMin.Y,
+                                  corner & 4 ? localMax.Z : localMin.Z, 1.f);
+    const HMM_Vec4 world = inst.worldFromObject * local;
+    for (int c = 0; c < 3; ++c) {
+      inst.boundsMin[c] = HMM_MIN(inst.boundsMin[c], world.Elements[c]);
+      inst.boundsMax[c] = HMM_MAX(inst.boundsMax[c], world.Elements[c]);
+    }
+  }
+}
+
+// Median split of instance centroids along the longest axis of the bounds.
+static void buildTlasNode(Scene& scene, uint32_t nodeIx, uint32_t first,
+                          uint32_t numInstances) {
+  TlasNode& node = scene.tlasNodes[nodeIx];
+  node.boundsMin = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+  node.boundsMax = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (uint32_t i = first; i < first + numInstances; ++i) {
+    const Instance& inst = scene.instances[scene.tlasInstanceIxs[i]];
+    for (int c = 0; c < 3; ++c) {
+      node.boundsMin[c] =
+          HMM_MIN(node.boundsMin[c], inst.boundsMin.Elements[c]);
+      node.boundsMax[c] =
+          HMM_MAX(node.boundsMax[c], inst.boundsMax.Elements[c]);
+    }
+  }
+
+  const uint32_t kMaxLeafInstances = 2;
+  if (numInstances <= kMaxLeafInstances) {
+    node.first = first;
+    node.numInstances = numInstances;
+    return;
+  }
+
+  const HMM_Vec3 extent = node.boundsMax - node.boundsMin;
+  const int axis = extent.X > extent.Y ? (extent.X > extent.Z ? 0 : 2)
+                                       : (extent.Y > extent.Z ? 1 : 2);
+  auto centroid = [&scene, axis](uint32_t instIx) {
+    const Instance& inst = scene.instances[instIx];
+    return inst.boundsMin.Elements[axis] + inst.boundsMax.Elements[axis];
+  };
+  const uint32_t half = numInstances / 2;
+  uint32_t* ixs = scene.tlasInstanceIxs + first;
+  std::nth_element(ixs, ixs + half, ixs + numInstances,
+                   [&centroid](uint32_t lhs, uint32_t rhs) {
+                     return centroid(lhs) < centroid(rhs);
+                   });
+
+  const uint32_t leftIx = scene.numTlasNodes;
+  scene.numTlasNodes += 2;
+  node.first = leftIx;
+  node.numInstances = 0;
+  buildTlasNode(scene, leftIx, first, half);
+  buildTlasNode(scene, leftIx + 1, first + half, numInstances - half);
+}
+
+// Computes instance bounds and radiance offsets, SoA copies of the meshes and
+// builds the top-level BVH.
+static void finalizeScene(Scene& scene) {
+  for (uint32_t meshIx = 0; meshIx < scene.numMeshes; ++meshIx) {
+    createMeshSoa(scene.meshes[meshIx]);
+  }
+  scene.numVertices = 0;
+  for (uint32_t instIx = 0; instIx < scene.numInstances; ++instIx) {
+    Instance& inst = scene.instances[instIx];
+    computeInstanceBounds(scene.meshes[inst.meshIx], inst);
+    inst.firstVertex = scene.numVertices;
+    scene.numVertices += scene.meshes[inst.meshIx].numVertices;
+  }
+
+  scene.tlasNodes = new TlasNode[2 * scene.numInstances];
+  scene.tlasInstanceIxs = new uint32_t[scene.numInstances];
+  for (uint32_t instIx = 0; instIx < scene.numInstances; ++instIx) {
+    scene.tlasInstanceIxs[instIx] = instIx;
+  }
+  scene.numTlasNodes = 1;
+  buildTlasNode(scene, 0, 0, scene.numInstances);
+}
+
+// Doubles the capacity of an array that holds count items.
+template <typename T>
+static T* growArray(T* items, uint32_t count, uint32_t& capacity) {
+  capacity *= 2;
+  T* grown = new T[capacity];
+  for (uint32_t i = 0; i < count; ++i) {
+    grown[i] = items[i];
+  }
+  delete[] items;
+  return grown;
+}
+
+Scene readSceneFromFile(const char* fileName) {
+  FILE* file{};
+  if (fopen_s(&file, fileName, "r") != 0) {
+    fatal("Failed to open scene file");
+  }
+
+  // mesh names are relative to the directory of the scene file
+  char dir[MAX_PATH];
+  strcpy_s(dir, fileName);
+  char* lastSep = strrchr(dir, '\\');
+  char* lastSlash = strrchr(dir, '/');
+  if (lastSlash > lastSep) {
+    lastSep = lastSlash;
+  }
+  lastSep ? lastSep[1] = '\0' : dir[0] = '\0';
+
+  // levels repeat a few meshes in many instances, both arrays grow as needed
+  uint32_t meshCapacity = 16;
+  uint32_t instanceCapacity = 1024;
+  Scene scene;
+  scene.meshes = new Mesh[meshCapacity];
+  scene.instances = new Instance[instanceCapacity];
+
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    char meshName[MAX_PATH];
+    uint32_t meshIx{};
+    float x{}, y{}, z{}, rotZ{}, scale{};
+    if (sscanf_s(line, " mesh %259s", meshName,
+                 static_cast<unsigned>(sizeof(meshName))) == 1) {
+      if (scene.numMeshes == meshCapacity) {
+        scene.meshes = growArray(scene.meshes, scene.numMeshes, meshCapacity);
+      }
+      char meshPath[MAX_PATH];
+      strcpy_s(meshPath, dir);
+      strcat_s(meshPath, meshName);
+      scene.meshes[scene.numMeshes++] = readMeshFromFile(meshPath);
+    } else if (sscanf_s(line, " instance %u %f %f %f %f %f", &meshIx, &x, &y,
+                        &z, &rotZ, &scale) == 6) {
+      if (meshIx >= scene.numMeshes) {
+        fatal("Instance refers to a mesh that is not declared before it.");
+      }
+      if (scene.numInstances == instanceCapacity) {
+        scene.instances =
+            growArray(scene.instances, scene.numInstances, instanceCapacity);
+      }
+      Instance& inst = scene.instances[scene.numInstances++];
+      inst.meshIx = meshIx;
+      inst.worldFromObject =
+          HMM_Translate(HMM_V3(x, y, z)) *
+          HMM_Rotate_RH(HMM_AngleDeg(rotZ), HMM_V3(0, 0, 1)) *
+          HMM_Scale(HMM_V3(scale, scale, scale));
+    }
+  }
+  fclose(file);
+
+  if (scene.numInstances == 0) {
+    fatal("Scene has no instances.");
+  }
+  finalizeScene(scene);
+  return scene;
+}
+
+Scene makeSingleMeshScene(const Mesh& mesh) {
+  Scene scene;
+  scene.numMeshes = 1;
+  scene.meshes = new Mesh[1]{mesh};
+  scene.numInstances = 1;
+  scene.instances = new Instance[1];
+  finalizeScene(scene);
+  return scene;
+}
+
+Scene readSceneAsset(const char* fileName) {
+  const char* ext = strrchr(fileName, '.');
+  if (ext && strcmp(ext, ".scene") == 0) {
+    return readSceneFromFile(fileName);
+  }
+  if (ext && strcmp(ext, ".cmesh") == 0) {
+    return makeSingleMeshScene(readChunkedMeshFromFile(fileName));
+  }
+  return makeSingleMeshScene(readMeshFromFile(fileName));
+}
+
+uint32_t getRadianceSizeBytes(RadianceFormat format) {
+  return format == RadianceFormat::Float16 ? 3 * sizeof(uint16_t)
+                                           : sizeof(HMM_Vec3);
+}
+
+void uploadRadiances(RadianceFormat format, uint32_t numVertices,
+                     const HMM_Vec3* radiances, uint16_t* staging) {
+  const GLsizeiptr sizeBytes = numVertices * getRadianceSizeBytes(format);
+  if (format == RadianceFormat::Float32) {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeBytes, radiances);
+    return;
+  }
+  for (uint32_t vertIx = 0; vertIx < numVertices; ++vertIx) {
+    for (uint32_t c = 0; c < 3; ++c) {
+      staging[3 * vertIx + c] = floatToHalf(radiances[vertIx].Elements[c]);
+    }
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeBytes, staging);
+}
+
+void setRadianceAttribPointer(RadianceFormat format, GLuint index,
+                              uint32_t firstVertex) {
+  glVertexAttribPointer(
+      index, 3,
+      format == RadianceFormat::Float16 ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE,
+      0,
+      reinterpret_cast<const void*>(uintptr_t{firstVertex} *
+                                    getRadianceSizeBytes(format)));
+}
+
+void createSceneBuffers(Scene& scene) {
+  auto createVertexBuffer = [](GLuint& id, GLsizeiptr size, const void* data) {
+    glCreateBuffers(1, &id);
+    glBindBuffer(GL_ARRAY_BUFFER, id);
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+  };
+
+  scene.meshBuffers = new MeshBuffers[scene.numMeshes];
+  for (uint32_t meshIx = 0; meshIx < scene.numMeshes; ++meshIx) {
+    const Mesh& mesh = scene.meshes[meshIx];
+    MeshBuffers& buffers = scene.meshBuffers[meshIx];
+    const GLsizeiptr bufferSizeBytes = mesh.numVertices * sizeof(HMM_Vec3);
+    createVertexBuffer(buffers.vbPosition, bufferSizeBytes, mesh.positions);
+    createVertexBuffer(buffers.vbNormal, bufferSizeBytes, mesh.normals);
+    glCreateBuffers(1, &buffers.ib);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.ib);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 mesh.numIndices * sizeof(unsigned int), mesh.indices,
+                 GL_STATIC_DRAW);
+  }
+
+  for (uint32_t instIx = 0; instIx < scene.numInstances; ++instIx) {
+    Instance& inst = scene.instances[instIx];
+    const MeshBuffers& buffers = scene.meshBuffers[inst.meshIx];
+    glCreateVertexArrays(1, &inst.vao);
+    glBindVertexArray(inst.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.vbPosition);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.vbNormal);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);  // color
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.ib);
+  }
+  glBindVertexArray(0);
+  setSceneColorFormat(scene, scene.colorFormat);
+}
+
+void setSceneColorFormat(Scene& scene, RadianceFormat format) {
+  if (scene.vbColor) {
+    glDeleteBuffers(1, &scene.vbColor);
+  }
+  delete[] scene.colorStaging;
+  scene.colorFormat = format;
+  scene.colorStaging = format == RadianceFormat::Float16
+                           ? new uint16_t[3 * scene.numVertices]
+                           : nullptr;
+
+  glCreateBuffers(1, &scene.vbColor);
+  glBindBuffer(GL_ARRAY_BUFFER, scene.vbColor);
+  glBufferData(GL_ARRAY_BUFFER,
+               scene.numVertices * getRadianceSizeBytes(format), nullptr,
+               GL_STATIC_DRAW);
+  HMM_Vec3* emission = new HMM_Vec3[scene.numVertices];
+  copySceneEmission(scene, emission);
+  uploadSceneColors(scene, emission);
+  delete[] emission;
+
+  for (uint32_t instIx = 0; instIx < scene.numInstances; ++instIx) {
+    const Instance& inst = scene.instances[instIx];
+    glBindVertexArray(inst.vao);
+    // each instance reads its own slice of the scene-wide color buffer
+    glBindBuffer(GL_ARRAY_BUFFER, scene.vbColor);
+    setRadianceAttribPointer(format, 2, inst.firstVertex);
+  }
+  glBindVertexArray(0);
+}
+
+void uploadSceneColors(const Scene& scene, const HMM_Vec3* radiances) {
+  glBindBuffer(GL_ARRAY_BUFFER, scene.vbColor);
+  uploadRadiances(scene.colorFormat, scene.numVertices, radiances,
+                  scene.colorStaging);
+}
+
+void copySceneEmission(const Scene& scene, HMM_Vec3* emission) {
+  for (uint32_t instIx = 0; instIx < scene.numInstances; ++instIx) {
+    const Instance& inst = scene.instances[instIx];
+    const Mesh& mesh = scene.meshes[inst.meshIx];
+    CopyMemory(emission + inst.firstVertex, mesh.colors,
+               sizeof(HMM_Vec3) * mesh.numVertices);
+  }
+}
+
+void getSceneVertex(const Scene& scene, uint32_t instIx, uint32_t vertIx,
+                    HMM_Vec3& position, HMM_Vec3& normal) {
+  const Instance& inst = scene.instances[instIx];
+  const Mesh& mesh = scene.meshes[inst.meshIx];
+  const HMM_Vec3& p = mesh.positions[vertIx];
+  const HMM_Vec3& n = mesh.normals[vertIx];
+  position = (inst.worldFromObject * HMM_V4(p.X, p.Y, p.Z, 1.f)).XYZ;
+  normal = HMM_NormV3((inst.worldFromObject * HMM_V4(n.X, n.Y, n.Z, 0.f)).XYZ);
+}
+
+bool boundsOverlapHemisphere(HMM_Vec3 boundsMin, HMM_Vec3 boundsMax,
+                             HMM_Vec3 position, HMM_Vec3 normal) {
+  // largest signed distance of a box corner to the plane of the hemisphere
+  const HMM_Vec3 absNormal =
+      HMM_V3(HMM_ABS(normal.X), HMM_ABS(normal.Y), HMM_ABS(normal.Z));
+  const HMM_Vec3 center = (boundsMin + boundsMax) * 0.5f;
+  const HMM_Vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+  return HMM_DotV3(center - position, normal) +
+             HMM_DotV3(halfExtent, absNormal) >=
+         0.f;
+}
+
+float getBoundsDistance(HMM_Vec3 aMin, HMM_Vec3 aMax, HMM_Vec3 bMin,
+                        HMM_Vec3 bMax) {
+  float sqDist = 0.f;
+  for (int c = 0; c < 3; ++c) {
+    const float gap =
+        HMM_MAX(0.f, HMM_MAX(aMin.Elements[c] - bMax.Elements[c],
+                             bMin.Elements[c] - aMax.Elements[c]));
+    sqDist += gap * gap;
+  }
+  return HMM_SqrtF(sqDist);
+}
+
+uint32_t collectHemisphereInstances(const Scene& scene, HMM_Vec3 position,
+                                    HMM_Vec3 normal, float farPlane,
+                                    uint32_t* instanceIxs) {
+  auto isInView = [position, normal, farPlane](HMM_Vec3 boundsMin,
+                                               HMM_Vec3 boundsMax) {
+    return getBoundsDistance(boundsMin, boundsMax, position, position) <=
+               farPlane &&
+           boundsOverlapHemisphere(boundsMin, boundsMax, position, normal);
+  };
+  uint32_t numVisible = 0;
+  uint32_t stack[64];
+  uint32_t stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const TlasNode& node = scene.tlasNodes[stack[--stackSize]];
+    if (!isInView(node.boundsMin, node.boundsMax)) {
+      continue;
+    }
+    if (node.numInstances > 0) {
+      for (uint32_t i = node.first; i < node.first + node.numInstances; ++i) {
+        const uint32_t instIx = scene.tlasInstanceIxs[i];
+        const Instance& inst = scene.instances[instIx];
+        if (isInView(inst.boundsMin, inst.boundsMax)) {
+          instanceIxs[numVisible++] = instIx;
+        }
+      }
+    } else {
+      stack[stackSize++] = node.first;
+      stack[stackSize++] = node.first + 1;
+    }
+  }
+  return numVisible;
+}
+
+void drawInstance(const Scene& scene, uint32_t instIx,
+                  GLint uWorldFromObjectLoc) {
+  const Instance& inst = scene.instances[instIx];
+  glUniformMatrix4fv(uWorldFromObjectLoc, 1, GL_FALSE,
+                     &inst.worldFromObject.Elements[0][0]);
+  glBindVertexArray(inst.vao);
+  glDrawElements(GL_TRIANGLES, scene.meshes[inst.meshIx].numIndices,
+                 GL_UNSIGNED_INT, nullptr);
+}
+
+void drawScene(const Scene& scene, GLint uWorldFromObjectLoc) {
+  for (uint32_t instIx = 0; instIx < scene.numInstances; ++instIx) {
+    drawInstance(scene, instIx, uWorldFromObjectLoc);
+  }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "mesh.hpp"
+#include "opengl.hpp"
+
+// Precision of vertex radiances on the GPU, i.e. of the color buffers the
+// gather renders with. CPU arrays stay float for the accumulation.
+enum class RadianceFormat : uint32_t { Float32, Float16 };
+
+uint32_t getRadianceSizeBytes(RadianceFormat format);
+// Uploads radiances into the bound GL_ARRAY_BUFFER from its start. Float16
+// converts through `staging`, which needs room for 3 * numVertices halves.
+void uploadRadiances(RadianceFormat format, uint32_t numVertices,
+                     const HMM_Vec3* radiances, uint16_t* staging);
+// Points the attribute at the radiances of the bound GL_ARRAY_BUFFER, starting
+// at firstVertex.
+void setRadianceAttribPointer(RadianceFormat format, GLuint index,
+                              uint32_t firstVertex);
+
+// GPU buffers of a mesh, shared by all of its instances.
+struct MeshBuffers {
+  GLuint vbPosition{};
+  GLuint vbNormal{};
+  GLuint ib{};
+};
+
+struct Instance {
+  uint32_t meshIx{};
+  // only rotations and uniform scales, so that normals can be transformed
+  // with the same matrix
+  HMM_Mat4 worldFromObject = HMM_M4D(1.f);
+  HMM_Vec3 boundsMin{};
+  HMM_Vec3 boundsMax{};
+  // offset of this instance's vertices in scene-wide radiance arrays
+  uint32_t firstVertex{};
+  GLuint vao{};
+};
+
+// Node of the top-level BVH over instance bounds. Leaves have numInstances > 0
+// and refer to tlasInstanceIxs[first, first + numInstances). Inner nodes have
+// their children at first and first + 1.
+struct TlasNode {
+  HMM_Vec3 boundsMin{};
+  HMM_Vec3 boundsMax{};
+  uint32_t first{};
+  uint32_t numInstances{};
+};
+
+// Many instances of a few shared meshes. Geometry is stored once per mesh,
+// radiances once per instance vertex.
+struct Scene {
+  uint32_t numMeshes{};
+  Mesh* meshes{};
+  MeshBuffers* meshBuffers{};
+  uint32_t numInstances{};
+  Instance* instances{};
+  // total number of instance vertices, size of radiance arrays
+  uint32_t numVertices{};
+  // vertex colors of all instances, i.e. the radiances to render with
+  GLuint vbColor{};
+  RadianceFormat colorFormat{};
+  // 3 * numVertices halves when colorFormat is Float16
+  uint16_t* colorStaging{};
+  uint32_t numTlasNodes{};
+  TlasNode* tlasNodes{};
+  uint32_t* tlasInstanceIxs{};
+};
+
+// Text format, one entry per line, '#' starts a comment:
+//   mesh <file name relative to the scene file>
+//   instance <mesh index> <x> <y> <z> <rotation around z in degrees> <scale>
+Scene readSceneFromFile(const char* fileName);
+// Scene with a single, untransformed instance of the given mesh.
+Scene makeSingleMeshScene(const Mesh& mesh);
+// Picks the loader by extension: .scene, .cmesh or .mesh
+Scene readSceneAsset(const char* fileName);
+
+// Creates vertex buffers and one VAO per instance, colors in
+// scene.colorFormat. Needs a GL context.
+void createSceneBuffers(Scene& scene);
+// Recreates the color buffer in another format, initialized to the emission.
+void setSceneColorFormat(Scene& scene, RadianceFormat format);
+// Uploads per instance vertex radiances to render with.
+void uploadSceneColors(const Scene& scene, const HMM_Vec3* radiances);
+// Copies the mesh colors of every instance into `emission`.
+void copySceneEmission(const Scene& scene, HMM_Vec3* emission);
+// World space position and normal of a scene vertex.
+void getSceneVertex(const Scene& scene, uint32_t instIx, uint32_t vertIx,
+                    HMM_Vec3& position, HMM_Vec3& normal);
+
+// Whether any part of the box lies in front of the plane through `position`
+// with `normal`, i.e. can be seen by a hemisphere gather from there.
+bool boundsOverlapHemisphere(HMM_Vec3 boundsMin, HMM_Vec3 boundsMax,
+                             HMM_Vec3 position, HMM_Vec3 normal);
+// Distance between two boxes, 0 when they overlap.
+float getBoundsDistance(HMM_Vec3 aMin, HMM_Vec3 aMax, HMM_Vec3 bMin,
+                        HMM_Vec3 bMax);
+// Writes indices of instances that overlap the hemisphere above `position`
+// around `normal` within farPlane into `instanceIxs` and returns their count.
+uint32_t collectHemisphereInstances(const Scene& scene, HMM_Vec3 position,
+                                    HMM_Vec3 normal, float farPlane,
+                                    uint32_t* instanceIxs);
+void drawInstance(const Scene& scene, uint32_t instIx,
+                  GLint uWorldFromObjectLoc);
+void drawScene(const Scene& scene, GLint uWorldFromObjectLoc);
@@ -0,0 +1,432 @@
+#include "stream.hpp"
+#include "cache.hpp"
+
+#include <Psapi.h>
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <print>
+
+namespace {
+struct ResidentChunk {
+  bool isResident{};
+  // iteration whose radiances are in vbColor
+  uint32_t colorIteration{UINT32_MAX};
+  uint64_t lastUsed{};
+  uint64_t sizeBytes{};
+  GLuint vbPosition{};
+  GLuint vbNormal{};
+  GLuint vbColor{};
+  GLuint ib{};
+  GLuint vao{};
+  // gather points of the chunk
+  HMM_Vec3* positions{};
+  HMM_Vec3* normals{};
+};
+
+// Bounding box of a group of gather points and a cone that contains their
+// normals, so that visibility of a chunk is decided once for the group.
+struct GatherCone {
+  HMM_Vec3 boundsMin;
+  HMM_Vec3 boundsMax;
+  HMM_Vec3 axis;
+  float halfAngle;
+};
+
+struct StreamGatherContext {
+  const ChunkedMesh* cmesh;
+  const ResidentChunk* residents;
+  const uint32_t* visibleChunkIxs;
+  uint32_t numVisible;
+};
+}  // namespace
+
+// CPU copies of positions and normals, GPU positions, normals and colors
+static uint64_t getChunkSizeBytes(const MeshChunk& chunk) {
+  return uint64_t{chunk.numVertices} * 5 * sizeof(HMM_Vec3) +
+         uint64_t{chunk.numIndices} * sizeof(unsigned int);
+}
+
+static GatherCone makeGatherCone(const HMM_Vec3* positions,
+                                 const HMM_Vec3* normals, uint32_t count) {
+  GatherCone cone;
+  cone.boundsMin = HMM_V3(FLT_MAX, FLT_MAX, FLT_MAX);
+  cone.boundsMax = HMM_V3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  HMM_Vec3 normalSum = HMM_V3(0.f, 0.f, 0.f);
+  bool hasZeroNormal = false;
+  for (uint32_t i = 0; i < count; ++i) {
+    for (int a = 0; a < 3; ++a) {
+      cone.boundsMin[a] = HMM_MIN(cone.boundsMin[a], positions[i].Elements[a]);
+      cone.boundsMax[a] = HMM_MAX(cone.boundsMax[a], positions[i].Elements[a]);
+    }
+    const float length = HMM_LenV3(normals[i]);
+    if (length > 0.f) {
+      normalSum += normals[i] / length;
+    } else {
+      hasZeroNormal = true;
+    }
+  }
+  // a point without normal sees everything, as does a group whose normals
+  // cancel out
+  const float sumLength = HMM_LenV3(normalSum);
+  if (hasZeroNormal || sumLength < 1e-3f) {
+    cone.axis = HMM_V3(0.f, 0.f, 1.f);
+    cone.halfAngle = HMM_PI32;
+    return cone;
+  }
+  cone.axis = normalSum / sumLength;
+  float minCos = 1.f;
+  for (uint32_t i = 0; i < count; ++i) {
+    minCos = HMM_MIN(minCos, HMM_DotV3(cone.axis, HMM_NormV3(normals[i])));
+  }
+  cone.halfAngle = std::acos(HMM_Clamp(-1.f, minCos, 1.f));
+  return cone;
+}
+
+// Whether any point in the cone's bounds with a normal in the cone may see
+// the chunk. The boxes are bounded by spheres, a point at distance rA from
+// the gather center and one at rB from the chunk center are in front of each
+// other when the centers are, by at least -(rA + rB).
+static bool coneSeesChunk(const GatherCone& cone, const MeshChunk& chunk,
+                          float farPlane) {
+  if (getBoundsDistance(cone.boundsMin, cone.boundsMax, chunk.boundsMin,
+                        chunk.boundsMax) > farPlane) {
+    return false;
+  }
+  const float radii = HMM_LenV3(cone.boundsMax - cone.boundsMin) * 0.5f +
+                      HMM_LenV3(chunk.boundsMax - chunk.boundsMin) * 0.5f;
+  const HMM_Vec3 toChunk = (chunk.boundsMin + chunk.boundsMax) * 0.5f -
+                           (cone.boundsMin + cone.boundsMax) * 0.5f;
+  const float distance = HMM_LenV3(toChunk);
+  if (distance <= radii) {
+    return true;
+  }
+  // the normal in the cone closest to toChunk
+  const float angle = std::acos(
+      HMM_Clamp(-1.f, HMM_DotV3(toChunk, cone.axis) / distance, 1.f));
+  return distance * std::cos(HMM_MAX(0.f, angle - cone.halfAngle)) + radii >=
+         0.f;
+}
+
+// Same as hashMeshGeometry of the mesh made by readChunkedMeshFromFile, one
+// pass over the file per attribute so that the mesh never is in memory.
+static uint64_t hashChunkedMeshGeometry(const ChunkedMesh& cmesh,
+                                        HMM_Vec3* attr, unsigned int* indices) {
+  uint64_t hash = hashBytes(&cmesh.header.numVertices, sizeof(unsigned int));
+  hash = hashBytes(&cmesh.header.numIndices, sizeof(unsigned int), hash);
+  for (int attrIx = 0; attrIx < 2; ++attrIx) {
+    for (uint32_t chunkIx = 0; chunkIx < cmesh.header.numChunks; ++chunkIx) {
+      const MeshChunk& chunk = cmesh.chunks[chunkIx];
+      readMeshChunk(cmesh, chunkIx, attrIx == 0 ? attr : nullptr,
+                    attrIx == 1 ? attr : nullptr, nullptr, nullptr);
+      hash = hashBytes(attr, sizeof(HMM_Vec3) * chunk.numVertices, hash);
+    }
+  }
+  for (uint32_t chunkIx = 0; chunkIx < cmesh.header.numChunks; ++chunkIx) {
+    const MeshChunk& chunk = cmesh.chunks[chunkIx];
+    readMeshChunk(cmesh, chunkIx, nullptr, nullptr, nullptr, indices);
+    for (uint32_t i = 0; i < chunk.numIndices; ++i) {
+      indices[i] += chunk.firstVertex;
+    }
+    hash = hashBytes(indices, sizeof(unsigned int) * chunk.numIndices, hash);
+  }
+  return hash;
+}
+
+static void evictChunk(ResidentChunk& r) {
+  glDeleteVertexArrays(1, &r.vao);
+  const GLuint buffers[] = {r.vbPosition, r.vbNormal, r.vbColor, r.ib};
+  glDeleteBuffers(4, buffers);
+  delete[] r.positions;
+  delete[] r.normals;
+  r = {};
+}
+
+static void loadChunk(const ChunkedMesh& cmesh, uint32_t chunkIx,
+                      RadianceFormat colorFormat, ResidentChunk& r,
+                      unsigned int* indices) {
+  const MeshChunk& chunk = cmesh.chunks[chunkIx];
+  r.positions = new HMM_Vec3[chunk.numVertices];
+  r.normals = new HMM_Vec3[chunk.numVertices];
+  readMeshChunk(cmesh, chunkIx, r.positions, r.normals, nullptr, indices);
+
+  auto createVertexBuffer = [](GLuint& id, GLsizeiptr size, const void* data) {
+    glCreateBuffers(1, &id);
+    glBindBuffer(GL_ARRAY_BUFFER, id);
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+  };
+  const GLsizeiptr bufferSizeBytes = chunk.numVertices * sizeof(HMM_Vec3);
+  createVertexBuffer(r.vbPosition, bufferSizeBytes, r.positions);
+  createVertexBuffer(r.vbNormal, bufferSizeBytes, r.normals);
+  createVertexBuffer(r.vbColor,
+                     chunk.numVertices * getRadianceSizeBytes(colorFormat),
+                     nullptr);
+  glCreateBuffers(1, &r.ib);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r.ib);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               chunk.numIndices * sizeof(unsigned int), indices,
+               GL_STATIC_DRAW);
+
+  glCreateVertexArrays(1, &r.vao);
+  glBindVertexArray(r.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, r.vbPosition);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, r.vbNormal);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glEnableVertexAttribArray(1);
+  glBindBuffer(GL_ARRAY_BUFFER, r.vbColor);
+  setRadianceAttribPointer(colorFormat, 2, 0);
+  glEnableVertexAttribArray(2);  // color
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r.ib);
+  glBindVertexArray(0);
+
+  r.isResident = true;
+  r.sizeBytes = getChunkSizeBytes(chunk);
+}
+
+static void drawStreamGatherView(const void* context, uint32_t pointIx,
+                                 HMM_Vec3 position, HMM_Vec3 normal) {
+  const StreamGatherContext& ctx =
+      *static_cast<const StreamGatherContext*>(context);
+  for (uint32_t i = 0; i < ctx.numVisible; ++i) {
+    const uint32_t chunkIx = ctx.visibleChunkIxs[i];
+    const MeshChunk& chunk = ctx.cmesh->chunks[chunkIx];
+    if (!boundsOverlapHemisphere(chunk.boundsMin, chunk.boundsMax, position,
+                                 normal)) {
+      continue;
+    }
+    glBindVertexArray(ctx.residents[chunkIx].vao);
+    glDrawElements(GL_TRIANGLES, chunk.numIndices, GL_UNSIGNED_INT, nullptr);
+  }
+}
+
+void streamBake(const Gatherer& g, const char* fileName,
+                uint64_t memoryCapBytes) {
+  ChunkedMesh cmesh = openChunkedMesh(fileName);
+  const uint32_t numChunks = cmesh.header.numChunks;
+  uint32_t maxChunkVertices = 0;
+  uint32_t maxChunkIndices = 0;
+  for (uint32_t chunkIx = 0; chunkIx < numChunks; ++chunkIx) {
+    const MeshChunk& chunk = cmesh.chunks[chunkIx];
+    maxChunkVertices = HMM_MAX(maxChunkVertices, chunk.numVertices);
+    maxChunkIndices = HMM_MAX(maxChunkIndices, chunk.numIndices);
+  }
+  // scratch buffers for a single chunk, the only per-vertex memory on the CPU
+  // besides the resident chunks
+  HMM_Vec3* emission = new HMM_Vec3[maxChunkVertices];
+  HMM_Vec3* radiances = new HMM_Vec3[maxChunkVertices];
+  HMM_Vec3* gathered = new HMM_Vec3[maxChunkVertices];
+  unsigned int* indices = new unsigned int[maxChunkIndices];
+  const RadianceFormat colorFormat = g.settings.radianceFormat;
+  uint16_t* colorStaging = colorFormat == RadianceFormat::Float16
+                               ? new uint16_t[3 * maxChunkVertices]
+                               : nullptr;
+
+  char cachePath[MAX_PATH];
+  snprintf(cachePath, MAX_PATH, "%s.cache", fileName);
+  BakeCacheHeader header;
+  header.numVertices = cmesh.header.numVertices;
+  header.meshHash = hashSingleMeshSceneGeometry(
+      hashChunkedMeshGeometry(cmesh, radiances, indices));
+  header.settingsHash = hashBakeSettings(g.settings, nullptr, 0);
+  for (uint32_t chunkIx = 0; chunkIx < numChunks; ++chunkIx) {
+    readMeshChunk(cmesh, chunkIx, nullptr, nullptr, emission, nullptr);
+    header.settingsHash = hashBytes(
+        emission, sizeof(HMM_Vec3) * cmesh.chunks[chunkIx].numVertices,
+        header.settingsHash);
+  }
+
+  // radiances of consecutive iterations ping-pong between two files
+  char passPaths[2][MAX_PATH];
+  HANDLE passFiles[2];
+  for (int i = 0; i < 2; ++i) {
+    snprintf(passPaths[i], MAX_PATH, "%s.pass%d", cachePath, i);
+    passFiles[i] =
+        CreateFileA(passPaths[i], GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                    CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (passFiles[i] == INVALID_HANDLE_VALUE) {
+      fatal("Failed to create radiance pass file.");
+    }
+  }
+
+  ResidentChunk* residents = new ResidentChunk[numChunks];
+  uint32_t* visibleChunkIxs = new uint32_t[numChunks];
+  uint64_t residentBytes = 0;
+  uint64_t epoch = 0;
+  uint64_t numChunkLoads = 0;
+
+  const HMM_Mat4 worldFromObject = HMM_M4D(1.f);
+  glUniformMatrix4fv(g.uWorldFromObjectLoc, 1, GL_FALSE,
+                     &worldFromObject.Elements[0][0]);
+
+  const uint32_t numIterations = g.settings.numBounces;
+  for (uint32_t iteration = 0; iteration < numIterations; ++iteration) {
+    // first iteration gathers the emission stored in the mesh
+    const HANDLE inputFile = iteration > 0 ? passFiles[(iteration + 1) % 2]
+                                           : INVALID_HANDLE_VALUE;
+    const HANDLE outputFile = passFiles[iteration % 2];
+    for (uint32_t gatherChunkIx = 0; gatherChunkIx < numChunks;
+         ++gatherChunkIx) {
+      ++epoch;
+      const MeshChunk& gatherChunk = cmesh.chunks[gatherChunkIx];
+
+      // chunks used in the current epoch are never evicted, the caller makes
+      // sure that they fit
+      auto makeResident = [&](uint32_t chunkIx) {
+        ResidentChunk& r = residents[chunkIx];
+        r.lastUsed = epoch;
+        if (!r.isResident) {
+          const uint64_t sizeBytes = getChunkSizeBytes(cmesh.chunks[chunkIx]);
+          while (residentBytes + sizeBytes > memoryCapBytes) {
+            uint32_t lruIx = UINT32_MAX;
+            for (uint32_t i = 0; i < numChunks; ++i) {
+              if (residents[i].isResident && residents[i].lastUsed < epoch &&
+                  (lruIx == UINT32_MAX ||
+                   residents[i].lastUsed < residents[lruIx].lastUsed)) {
+                lruIx = i;
+              }
+            }
+            if (lruIx == UINT32_MAX) {
+              fatal("Resident chunks exceed the memory cap.");
+            }
+            residentBytes -= residents[lruIx].sizeBytes;
+            evictChunk(residents[lruIx]);
+          }
+          loadChunk(cmesh, chunkIx, colorFormat, r, indices);
+          residentBytes += r.sizeBytes;
+          ++numChunkLoads;
+        }
+        if (r.colorIteration != iteration) {
+          const MeshChunk& chunk = cmesh.chunks[chunkIx];
+          const DWORD sizeBytes = chunk.numVertices * sizeof(HMM_Vec3);
+          const uint64_t offset =
+              sizeof(BakeCacheHeader) +
+              uint64_t{chunk.firstVertex} * sizeof(HMM_Vec3);
+          if (iteration == 0) {
+            readMeshChunk(cmesh, chunkIx, nullptr, nullptr, radiances,
+                          nullptr);
+          } else if (!readFileAt(inputFile, offset, radiances, sizeBytes)) {
+            fatal("Failed to read radiances of previous iteration.");
+          }
+          glBindBuffer(GL_ARRAY_BUFFER, r.vbColor);
+          uploadRadiances(colorFormat, chunk.numVertices, radiances,
+                          colorStaging);
+          r.colorIteration = iteration;
+        }
+      };
+      // the gather chunk first since its vertices are needed to find the
+      // other visible chunks
+      const uint64_t gatherChunkBytes = getChunkSizeBytes(gatherChunk);
+      if (gatherChunkBytes > memoryCapBytes) {
+        fatal("A single chunk exceeds the memory cap, use smaller chunks.");
+      }
+      makeResident(gatherChunkIx);
+      const ResidentChunk& gatherResident = residents[gatherChunkIx];
+
+      // Gather points are split into groups whose visible chunks fit into
+      // memoryCapBytes together, halving ranges of points until they do.
+      uint32_t groupStack[2 * 64];
+      uint32_t stackSize = 0;
+      groupStack[stackSize++] = 0;
+      groupStack[stackSize++] = gatherChunk.numVertices;
+      while (stackSize > 0) {
+        const uint32_t groupCount = groupStack[--stackSize];
+        const uint32_t groupFirst = groupStack[--stackSize];
+        const GatherCone cone =
+            makeGatherCone(gatherResident.positions + groupFirst,
+                           gatherResident.normals + groupFirst, groupCount);
+        uint32_t numVisible = 0;
+        uint64_t visibleBytes = gatherChunkBytes;
+        for (uint32_t chunkIx = 0; chunkIx < numChunks; ++chunkIx) {
+          const MeshChunk& chunk = cmesh.chunks[chunkIx];
+          if (chunkIx == gatherChunkIx ||
+              coneSeesChunk(cone, chunk, g.settings.farPlane)) {
+            visibleChunkIxs[numVisible++] = chunkIx;
+            if (chunkIx != gatherChunkIx) {
+              visibleBytes += getChunkSizeBytes(chunk);
+            }
+          }
+        }
+        if (visibleBytes > memoryCapBytes) {
+          if (groupCount == 1) {
+            fatal("Chunks visible from a single gather point exceed the "
+                  "memory cap, use smaller chunks.");
+          }
+          const uint32_t half = groupCount / 2;
+          // the first half is processed first
+          groupStack[stackSize++] = groupFirst + half;
+          groupStack[stackSize++] = groupCount - half;
+          groupStack[stackSize++] = groupFirst;
+          groupStack[stackSize++] = half;
+          continue;
+        }
+
+        ++epoch;
+        makeResident(gatherChunkIx);
+        for (uint32_t i = 0; i < numVisible; ++i) {
+          makeResident(visibleChunkIxs[i]);
+        }
+        const StreamGatherContext ctx{&cmesh, residents, visibleChunkIxs,
+                                      numVisible};
+        const uint32_t numViewports = g.settings.numViewports;
+        const uint32_t groupEnd = groupFirst + groupCount;
+        for (uint32_t first = groupFirst; first < groupEnd;
+             first += numViewports) {
+          gatherBatch(g, HMM_MIN(numViewports, groupEnd - first),
+                      gatherResident.positions + first,
+                      gatherResident.normals + first, drawStreamGatherView,
+                      &ctx, gathered + first);
+        }
+      }
+      readMeshChunk(cmesh, gatherChunkIx, nullptr, nullptr, emission, nullptr);
+      for (uint32_t v = 0; v < gatherChunk.numVertices; ++v) {
+        gathered[v] += emission[v];
+      }
+      const uint64_t offset =
+          sizeof(BakeCacheHeader) +
+          uint64_t{gatherChunk.firstVertex} * sizeof(HMM_Vec3);
+      if (!writeFileAt(outputFile, offset, gathered,
+                       gatherChunk.numVertices * sizeof(HMM_Vec3))) {
+        fatal("Failed to write radiances.");
+      }
+    }
+    std::println("Iteration {}/{} done, {} chunk loads so far", iteration + 1,
+                 numIterations, numChunkLoads);
+  }
+
+  const int resultIx = (numIterations + 1) % 2;
+  if (!writeFileAt(passFiles[resultIx], 0, &header, sizeof(header))) {
+    fatal("Failed to write radiance cache header.");
+  }
+  for (int i = 0; i < 2; ++i) {
+    CloseHandle(passFiles[i]);
+  }
+  if (numIterations == 0 ||
+      !MoveFileExA(passPaths[resultIx], cachePath,
+                   MOVEFILE_REPLACE_EXISTING)) {
+    fatal("Failed to write radiance cache.");
+  }
+  DeleteFileA(passPaths[numIterations % 2]);
+
+  PROCESS_MEMORY_COUNTERS memCounters{};
+  memCounters.cb = sizeof(memCounters);
+  GetProcessMemoryInfo(GetCurrentProcess(), &memCounters, sizeof(memCounters));
+  std::println("Wrote {}, peak working set {} MiB", cachePath,
+               memCounters.PeakWorkingSetSize >> 20);
+
+  for (uint32_t chunkIx = 0; chunkIx < numChunks; ++chunkIx) {
+    if (residents[chunkIx].isResident) {
+      evictChunk(residents[chunkIx]);
+    }
+  }
+  delete[] visibleChunkIxs;
+  delete[] residents;
+  delete[] colorStaging;
+  delete[] indices;
+  delete[] gathered;
+  delete[] radiances;
+  delete[] emission;
+  closeChunkedMesh(cmesh);
+}
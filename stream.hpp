@@ -0,0 +1,14 @@
+#pragma once
+
+#include "chunked.hpp"
+#include "gather.hpp"
+
+// Out-of-core bake of a chunked mesh. Gather points are processed chunk by
+// chunk, in groups whose chunks in view (within farPlane and in front of the
+// bounds and normal cone of the group) fit into memoryCapBytes. Resident
+// chunks are evicted least recently used, a chunk or the view of a single
+// gather point that does not fit is fatal. Radiances of every Jacobi iteration are
+// streamed through files on disk, the result becomes the radiance cache of
+// the chunked mesh (<fileName>.cache) so that the viewer can load it.
+void streamBake(const Gatherer& g, const char* fileName,
+                uint64_t memoryCapBytes);
@@ -0,0 +1,151 @@
+#include "sweep.hpp"
+
+#include "cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <print>
+
+GatherSettings makeReferenceGatherSettings(const GatherSettings& settings) {
+  GatherSettings reference = settings;
+  reference.viewportSide = 128;
+  reference.numViewports = kMaxAtlasWidth / reference.viewportSide;
+  reference.highFOV = HMM_PI32 - 0.05f;
+  reference.numBounces = 8;
+  return reference;
+}
+
+// Estimate of the memory scene gathers use, drivers may pad texels. The
+// atlas is read back through the pixel pack buffers, g.pixels only serves
+// gatherBatch.
+static uint64_t getGathererMemoryBytes(const Gatherer& g) {
+  const uint32_t colorTexelBytes =
+      g.settings.colorFormat == GatherColorFormat::RGB32F    ? 12
+      : g.settings.colorFormat == GatherColorFormat::RGBA16F ? 8
+                                                             : 4;
+  const uint32_t depthTexelBytes =
+      g.settings.depthFormat == GatherDepthFormat::Depth16 ? 2 : 4;
+  return static_cast<uint64_t>(g.texWidth) * g.texHeight *
+             (colorTexelBytes + depthTexelBytes) +
+         static_cast<uint64_t>(g.settings.numReadbackSlots) * g.rowSizeBytes *
+             g.texHeight;
+}
+
+// Loads the reference solution from the cache next to the asset or bakes it.
+static void getReferenceRadiances(const Scene& scene, const char* assetPath,
+                                  GLuint prog, const GatherSettings& settings,
+                                  const HMM_Vec3* emission,
+                                  HMM_Vec3* reference, HMM_Vec3* scratch) {
+  const GatherSettings referenceSettings = makeReferenceGatherSettings(settings);
+  char referencePath[MAX_PATH];
+  strcpy_s(referencePath, assetPath);
+  strcat_s(referencePath, ".reference");
+  const uint64_t meshHash = hashSceneGeometry(scene);
+  const uint64_t settingsHash =
+      hashBakeSettings(referenceSettings, emission, scene.numVertices);
+  BakeCache cache;
+  const BakeCacheMatch match = openBakeCache(
+      referencePath, meshHash, settingsHash, scene.numVertices, cache);
+  if (match == BakeCacheMatch::Exact) {
+    std::println("Loaded reference {}", referencePath);
+    CopyMemory(reference, cache.radiances,
+               scene.numVertices * sizeof(HMM_Vec3));
+    closeBakeCache(cache);
+    return;
+  }
+  closeBakeCache(cache);
+
+  std::println("Baking reference, viewportSide {}, {} bounces",
+               referenceSettings.viewportSide, referenceSettings.numBounces);
+  Gatherer g = createGatherer(referenceSettings, prog);
+  CopyMemory(reference, emission, scene.numVertices * sizeof(HMM_Vec3));
+  for (uint32_t bounceNo = 0; bounceNo < referenceSettings.numBounces;
+       ++bounceNo) {
+    iterateRadiances(g, scene, emission, reference, scratch);
+    std::println("  bounce {} done", bounceNo + 1);
+  }
+  destroyGatherer(g);
+  if (writeBakeCache(referencePath, meshHash, settingsHash, scene.numVertices,
+                     reference)) {
+    std::println("Wrote reference {}", referencePath);
+  }
+}
+
+void runGatherSweep(const Scene& scene, const char* assetPath, GLuint prog,
+                    const GatherSettings& settings) {
+  const uint32_t numVertices = scene.numVertices;
+  HMM_Vec3* emission = new HMM_Vec3[numVertices];
+  HMM_Vec3* reference = new HMM_Vec3[numVertices];
+  HMM_Vec3* radiances = new HMM_Vec3[numVertices];
+  HMM_Vec3* scratch = new HMM_Vec3[numVertices];
+  copySceneEmission(scene, emission);
+  getReferenceRadiances(scene, assetPath, prog, settings, emission, reference,
+                        scratch);
+
+  constexpr uint32_t kNumSides =
+      sizeof(kSweepViewportSides) / sizeof(kSweepViewportSides[0]);
+  constexpr uint32_t kNumFovs = sizeof(kSweepHighFovs) / sizeof(kSweepHighFovs[0]);
+  constexpr uint32_t kNumResults = kNumSides * kNumFovs * kSweepMaxBounces;
+  SweepResult* results = new SweepResult[kNumResults];
+  uint32_t numResults = 0;
+  for (uint32_t sideIx = 0; sideIx < kNumSides; ++sideIx) {
+    for (uint32_t fovIx = 0; fovIx < kNumFovs; ++fovIx) {
+      GatherSettings sweepSettings = settings;
+      sweepSettings.viewportSide = kSweepViewportSides[sideIx];
+      sweepSettings.numViewports = HMM_MIN(
+          settings.numViewports, kMaxAtlasWidth / sweepSettings.viewportSide);
+      sweepSettings.highFOV = kSweepHighFovs[fovIx];
+      Gatherer g = createGatherer(sweepSettings, prog);
+      const uint64_t memoryBytes = getGathererMemoryBytes(g);
+
+      // a bake with n bounces is the first n steps of one with more, so every
+      // bounce count is measured by a single bake
+      CopyMemory(radiances, emission, numVertices * sizeof(HMM_Vec3));
+      double bakeMs = 0;
+      for (uint32_t bounceNo = 1; bounceNo <= kSweepMaxBounces; ++bounceNo) {
+        const auto start = std::chrono::steady_clock::now();
+        iterateRadiances(g, scene, emission, radiances, scratch);
+        bakeMs += std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+        SweepResult& result = results[numResults++];
+        result.settings = sweepSettings;
+        result.settings.numBounces = bounceNo;
+        result.bakeMs = bakeMs;
+        result.memoryBytes = memoryBytes;
+        result.error = measureRadianceError(reference, radiances, numVertices);
+      }
+      destroyGatherer(g);
+    }
+  }
+
+  std::sort(results, results + numResults,
+            [](const SweepResult& a, const SweepResult& b) {
+              return a.bakeMs < b.bakeMs;
+            });
+  double bestRmse = INFINITY;
+  for (uint32_t i = 0; i < numResults; ++i) {
+    results[i].isParetoOptimal = results[i].error.rmse < bestRmse;
+    bestRmse = HMM_MIN(bestRmse, results[i].error.rmse);
+  }
+
+  std::println("{:>4} {:>8} {:>7} {:>10} {:>10} {:>10} {:>9} {:>9}", "side",
+               "FOV deg", "bounces", "rel RMSE", "max rel", "bake ms",
+               "mem KiB", "pareto");
+  for (uint32_t i = 0; i < numResults; ++i) {
+    const SweepResult& result = results[i];
+    std::println("{:>4} {:>8.1f} {:>7} {:>10.6f} {:>10.6f} {:>10.1f} {:>9} {:>9}",
+                 result.settings.viewportSide,
+                 HMM_ToDeg(result.settings.highFOV), result.settings.numBounces,
+                 result.error.rmse, result.error.maxRelative, result.bakeMs,
+                 result.memoryBytes >> 10,
+                 result.isParetoOptimal ? "*" : "");
+  }
+
+  delete[] results;
+  delete[] scratch;
+  delete[] radiances;
+  delete[] reference;
+  delete[] emission;
+}
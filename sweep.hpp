@@ -0,0 +1,36 @@
+#pragma once
+
+#include "precision.hpp"
+
+// Quality versus cost of gather settings. A high resolution reference
+// solution is baked once per asset and cached in <asset>.reference, then
+// every combination of the swept parameters is baked from the emission and
+// compared against it.
+constexpr GLsizei kSweepViewportSides[] = {8, 16, 32, 64};
+constexpr float kSweepHighFovs[] = {HMM_PI32 / 1.5f, HMM_PI32 / 1.25f,
+                                    HMM_PI32 - 0.05f};
+// rows are recorded after every bounce up to this many
+constexpr uint32_t kSweepMaxBounces = 4;
+// widest atlas created, numViewports is reduced for large viewports
+constexpr GLsizei kMaxAtlasWidth = 8192;
+
+// Settings of the reference bake, based on `settings` for everything that
+// is not swept.
+GatherSettings makeReferenceGatherSettings(const GatherSettings& settings);
+
+struct SweepResult {
+  GatherSettings settings;
+  double bakeMs{};
+  // atlas textures and the readback buffers
+  uint64_t memoryBytes{};
+  RadianceError error;
+  // no other setting is both faster and has a lower RMSE
+  bool isParetoOptimal{};
+};
+
+// Bakes the scene with every swept setting and prints one row per setting,
+// sorted by bake time with the Pareto front marked. `settings` provides the
+// precision formats and worker threads. Expects the gather program to be
+// bound.
+void runGatherSweep(const Scene& scene, const char* assetPath, GLuint prog,
+                    const GatherSettings& settings);
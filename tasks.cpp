@@ -0,0 +1,142 @@
+#include "tasks.hpp"
+
+static thread_local uint32_t tThreadIx = 0;
+
+static bool pushTask(TaskDeque& d, const Task& task) {
+  std::lock_guard<std::mutex> lock(d.mutex);
+  if (d.tail - d.head == kTaskDequeCapacity) return false;
+  d.tasks[d.tail % kTaskDequeCapacity] = task;
+  ++d.tail;
+  return true;
+}
+
+static bool popTask(TaskDeque& d, Task& task) {
+  std::lock_guard<std::mutex> lock(d.mutex);
+  if (d.tail == d.head) return false;
+  --d.tail;
+  task = d.tasks[d.tail % kTaskDequeCapacity];
+  return true;
+}
+
+static bool stealTask(TaskDeque& d, Task& task) {
+  std::lock_guard<std::mutex> lock(d.mutex);
+  if (d.tail == d.head) return false;
+  task = d.tasks[d.head % kTaskDequeCapacity];
+  ++d.head;
+  return true;
+}
+
+static void wakeWorker(TaskScheduler& s) {
+  // taking the lock orders the notification after a sleeping worker checked
+  // numQueued, otherwise the wake up could get lost
+  { std::lock_guard<std::mutex> lock(s.sleepMutex); }
+  s.wake.notify_one();
+}
+
+static bool findTask(TaskScheduler& s, Task& task) {
+  const uint32_t self = tThreadIx;
+  if (popTask(s.deques[self], task)) {
+    s.numQueued.fetch_sub(1);
+    return true;
+  }
+  for (uint32_t i = 1; i < s.numThreads; ++i) {
+    if (stealTask(s.deques[(self + i) % s.numThreads], task)) {
+      s.numQueued.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void runTask(TaskScheduler& s, Task task) {
+  TaskDeque& d = s.deques[tThreadIx];
+  while (task.count > task.grainSize) {
+    Task upper = task;
+    task.count /= 2;
+    upper.first += task.count;
+    upper.count -= task.count;
+    if (!pushTask(d, upper)) {
+      // deque is full, run the whole remaining range here
+      task.count += upper.count;
+      break;
+    }
+    s.numQueued.fetch_add(1);
+    wakeWorker(s);
+  }
+  task.fn(task.context, task.first, task.count);
+  task.group->numPending.fetch_sub(task.count, std::memory_order_release);
+}
+
+static void runWorker(TaskScheduler* s, uint32_t threadIx) {
+  tThreadIx = threadIx;
+  Task task;
+  while (true) {
+    if (findTask(*s, task)) {
+      runTask(*s, task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(s->sleepMutex);
+    s->wake.wait(lock, [s] { return s->numQueued > 0 || s->quit; });
+    if (s->quit) return;
+  }
+}
+
+TaskScheduler* createTaskScheduler(uint32_t numWorkerThreads) {
+  TaskScheduler* s = new TaskScheduler;
+  s->numThreads = numWorkerThreads + 1;
+  s->deques = new TaskDeque[s->numThreads];
+  s->workers = new std::thread[numWorkerThreads];
+  for (uint32_t i = 0; i < numWorkerThreads; ++i) {
+    s->workers[i] = std::thread(runWorker, s, i + 1);
+  }
+  return s;
+}
+
+void destroyTaskScheduler(TaskScheduler* s) {
+  {
+    std::lock_guard<std::mutex> lock(s->sleepMutex);
+    s->quit = true;
+  }
+  s->wake.notify_all();
+  for (uint32_t i = 0; i + 1 < s->numThreads; ++i) {
+    s->workers[i].join();
+  }
+  delete[] s->workers;
+  delete[] s->deques;
+  delete s;
+}
+
+uint32_t getTaskThreadIx() { return tThreadIx; }
+
+void submitTasks(TaskScheduler& s, TaskGroup& group, TaskFn fn,
+                 const void* context, uint32_t first, uint32_t count,
+                 uint32_t grainSize) {
+  if (count == 0) return;
+  const Task task{fn, context, &group, first, count,
+                  grainSize > 0 ? grainSize : 1};
+  group.numPending.fetch_add(count);
+  if (!pushTask(s.deques[tThreadIx], task)) {
+    runTask(s, task);
+    return;
+  }
+  s.numQueued.fetch_add(1);
+  wakeWorker(s);
+}
+
+void waitForTasks(TaskScheduler& s, TaskGroup& group) {
+  Task task;
+  while (group.numPending.load(std::memory_order_acquire) != 0) {
+    if (findTask(s, task)) {
+      runTask(s, task);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void parallelFor(TaskScheduler& s, TaskFn fn, const void* context,
+                 uint32_t first, uint32_t count, uint32_t grainSize) {
+  TaskGroup group;
+  submitTasks(s, group, fn, context, first, count, grainSize);
+  waitForTasks(s, group);
+}
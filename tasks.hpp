@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Work-stealing scheduler for CPU work over index ranges. Every thread owns a
+// deque of range tasks. A thread takes the newest task of its own deque and
+// halves it until it is at most grainSize items long, pushing the upper halves
+// back. Idle threads steal the oldest, hence largest, ranges of other threads,
+// so ranges with very uneven per-item cost still keep all threads busy.
+
+// Processes items [first, first + count) of a range.
+using TaskFn = void (*)(const void* context, uint32_t first, uint32_t count);
+
+// Tasks that can be waited for together.
+struct TaskGroup {
+  // items of the group's ranges that are not processed yet
+  std::atomic<uint32_t> numPending{};
+};
+
+struct Task {
+  TaskFn fn{};
+  const void* context{};
+  TaskGroup* group{};
+  uint32_t first{};
+  uint32_t count{};
+  uint32_t grainSize{};
+};
+
+// must be a power of two
+constexpr uint32_t kTaskDequeCapacity = 256;
+
+// Ring buffer of tasks. The owner pushes and pops at tail, thieves take from
+// head.
+struct TaskDeque {
+  std::mutex mutex;
+  Task tasks[kTaskDequeCapacity];
+  uint32_t head{};
+  uint32_t tail{};
+};
+
+struct TaskScheduler {
+  // thread 0 is the thread that created the scheduler, it runs tasks while it
+  // waits for them
+  uint32_t numThreads{};
+  TaskDeque* deques{};
+  std::thread* workers{};
+  std::atomic<uint32_t> numQueued{};
+  std::atomic<bool> quit{};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+};
+
+// Starts numWorkerThreads threads in addition to the calling one.
+TaskScheduler* createTaskScheduler(uint32_t numWorkerThreads);
+void destroyTaskScheduler(TaskScheduler* s);
+
+// Index of the scheduler thread running the current task, in [0, numThreads).
+// Meant for per thread scratch memory.
+uint32_t getTaskThreadIx();
+
+// Queues fn over [first, first + count) in tasks of at most grainSize items.
+// `context` has to stay valid until the group is waited for.
+void submitTasks(TaskScheduler& s, TaskGroup& group, TaskFn fn,
+                 const void* context, uint32_t first, uint32_t count,
+                 uint32_t grainSize);
+// Runs queued tasks of any group until all tasks of `group` are done.
+void waitForTasks(TaskScheduler& s, TaskGroup& group);
+// submitTasks and waitForTasks in one.
+void parallelFor(TaskScheduler& s, TaskFn fn, const void* context,
+                 uint32_t first, uint32_t count, uint32_t grainSize);